@@ -0,0 +1,240 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <time.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/sendfile.h>
+#include <openssl/evp.h>
+#include "blob_store.h"
+
+// Hashes with an upload in progress; two writers must not share a .part.
+// Each holds its full size against the quota until it finishes.
+static char active_uploads[MAX_ACTIVE_UPLOADS][BLOB_HASH_LEN + 1];
+static long reserved[MAX_ACTIVE_UPLOADS];
+static pthread_mutex_t uploads_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+int blob_valid_hash(const char *hash) {
+    if (strlen(hash) != BLOB_HASH_LEN) return 0;
+    for (const char *c = hash; *c; c++) {
+        if (!((*c >= '0' && *c <= '9') || (*c >= 'a' && *c <= 'f'))) return 0;
+    }
+    return 1;
+}
+
+long blob_size(const char *hash) {
+    char path[128];
+    struct stat st;
+    if (!blob_valid_hash(hash)) return -1;
+    snprintf(path, sizeof(path), "%s/%s", BLOB_DIR, hash);
+    return stat(path, &st) == 0 ? (long)st.st_size : -1;
+}
+
+// A .part nobody has written to for BLOB_PART_TTL is an abandoned upload.
+// Caller holds uploads_mutex; uploads in progress and 'keep' are spared.
+static int part_expired(const char *name, const struct stat *st, const char *keep) {
+    size_t len = strlen(name);
+    if (len != BLOB_HASH_LEN + 5 || strcmp(name + BLOB_HASH_LEN, ".part") != 0) return 0;
+    if (time(NULL) - st->st_mtime < BLOB_PART_TTL) return 0;
+    if (strncmp(name, keep, BLOB_HASH_LEN) == 0) return 0;
+    for (int i = 0; i < MAX_ACTIVE_UPLOADS; i++) {
+        if (strncmp(name, active_uploads[i], BLOB_HASH_LEN) == 0) return 0;
+    }
+    return 1;
+}
+
+// Bytes currently in BLOB_DIR; the directory is bounded by the quota itself.
+// Expired .part files are removed on the way instead of being counted.
+static long store_usage(const char *keep) {
+    DIR *d = opendir(BLOB_DIR);
+    if (!d) return 0;
+    long total = 0;
+    char path[512];
+    struct stat st;
+    struct dirent *e;
+    while ((e = readdir(d))) {
+        if (e->d_name[0] == '.') continue;
+        snprintf(path, sizeof(path), "%s/%s", BLOB_DIR, e->d_name);
+        if (stat(path, &st) != 0 || !S_ISREG(st.st_mode)) continue;
+        if (part_expired(e->d_name, &st, keep) && unlink(path) == 0) continue;
+        total += st.st_size;
+    }
+    closedir(d);
+    return total;
+}
+
+// Returns the slot, -1 if the hash is already being uploaded or the table is
+// full, -2 if the store cannot fit another 'size' bytes
+static int claim_upload(const char *hash, long size) {
+    int slot = -1;
+    pthread_mutex_lock(&uploads_mutex);
+    for (int i = 0; i < MAX_ACTIVE_UPLOADS; i++) {
+        if (strcmp(active_uploads[i], hash) == 0) { slot = -1; break; }
+        if (slot < 0 && !active_uploads[i][0]) slot = i;
+    }
+    if (slot >= 0) {
+        // Our own .part is already on disk and is part of 'size'
+        char part[128];
+        struct stat st;
+        snprintf(part, sizeof(part), "%s/%s.part", BLOB_DIR, hash);
+        long used = store_usage(hash) - (stat(part, &st) == 0 ? (long)st.st_size : 0);
+        for (int i = 0; i < MAX_ACTIVE_UPLOADS; i++) {
+            if (active_uploads[i][0]) used += reserved[i];
+        }
+        if (used + size > MAX_BLOB_STORE) slot = -2;
+    }
+    if (slot >= 0) {
+        strcpy(active_uploads[slot], hash);
+        reserved[slot] = size;
+    }
+    pthread_mutex_unlock(&uploads_mutex);
+    return slot;
+}
+
+static void release_upload(int slot) {
+    pthread_mutex_lock(&uploads_mutex);
+    active_uploads[slot][0] = '\0';
+    reserved[slot] = 0;
+    pthread_mutex_unlock(&uploads_mutex);
+}
+
+// Sleep just long enough to keep 'bytes' since 'start' under TRANSFER_RATE
+static void pace(const struct timespec *start, long bytes) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    double elapsed = (now.tv_sec - start->tv_sec) + (now.tv_nsec - start->tv_nsec) / 1e9;
+    double target = (double)bytes / TRANSFER_RATE;
+    if (target > elapsed) usleep((useconds_t)((target - elapsed) * 1e6));
+}
+
+static int hash_file(const char *path, char *hex_out) {
+    FILE *f = fopen(path, "rb");
+    if (!f) return 0;
+    EVP_MD_CTX *ctx = EVP_MD_CTX_new();
+    EVP_DigestInit_ex(ctx, EVP_sha256(), NULL);
+    char buf[TRANSFER_CHUNK];
+    size_t n;
+    while ((n = fread(buf, 1, sizeof(buf), f)) > 0) EVP_DigestUpdate(ctx, buf, n);
+    fclose(f);
+
+    unsigned char digest[32];
+    unsigned int len = 0;
+    EVP_DigestFinal_ex(ctx, digest, &len);
+    EVP_MD_CTX_free(ctx);
+    for (unsigned int i = 0; i < len; i++) sprintf(hex_out + i * 2, "%02x", digest[i]);
+    return 1;
+}
+
+static void reply(int sock, const char *msg) {
+    send(sock, msg, strlen(msg), MSG_NOSIGNAL);
+}
+
+void blob_upload(int sock, const char *hash, long size) {
+    char path[128], part[128], msg[64];
+    if (!blob_valid_hash(hash) || size <= 0 || size > MAX_BLOB_SIZE) {
+        reply(sock, "ERR bad request\n");
+        return;
+    }
+
+    // Content-addressed: an identical file is never uploaded twice
+    if (blob_size(hash) == size) {
+        sprintf(msg, "OFFSET %ld\nOK\n", size);
+        reply(sock, msg);
+        return;
+    }
+
+    int slot = claim_upload(hash, size);
+    if (slot < 0) {
+        reply(sock, slot == -2 ? "ERR quota\n" : "ERR busy\n");
+        return;
+    }
+
+    mkdir(BLOB_DIR, 0755);
+    snprintf(path, sizeof(path), "%s/%s", BLOB_DIR, hash);
+    snprintf(part, sizeof(part), "%s/%s.part", BLOB_DIR, hash);
+
+    // Resume from whatever an earlier, interrupted upload left behind
+    int fd = open(part, O_WRONLY | O_CREAT | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        release_upload(slot);
+        reply(sock, "ERR storage\n");
+        return;
+    }
+    long have = lseek(fd, 0, SEEK_END);
+    if (have > size) {
+        if (ftruncate(fd, 0) < 0) have = -1;
+        else have = lseek(fd, 0, SEEK_SET);
+    }
+    if (have < 0) {
+        close(fd);
+        release_upload(slot);
+        reply(sock, "ERR storage\n");
+        return;
+    }
+    sprintf(msg, "OFFSET %ld\n", have);
+    reply(sock, msg);
+
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    long received = 0;
+    char buf[TRANSFER_CHUNK];
+    while (have < size) {
+        long want = size - have < (long)sizeof(buf) ? size - have : (long)sizeof(buf);
+        ssize_t n = recv(sock, buf, want, 0);
+        if (n <= 0 || write(fd, buf, n) != n) break;
+        have += n;
+        received += n;
+        pace(&start, received);
+    }
+    close(fd);
+    if (have < size) {
+        release_upload(slot); // .part stays for a resumed upload
+        return;
+    }
+
+    char actual[BLOB_HASH_LEN + 1] = "";
+    if (hash_file(part, actual) && strcmp(actual, hash) == 0 && rename(part, path) == 0) {
+        reply(sock, "OK\n");
+    } else {
+        remove(part);
+        reply(sock, "ERR hash mismatch\n");
+    }
+    release_upload(slot);
+}
+
+void blob_download(int sock, const char *hash, long offset) {
+    char path[128], msg[64];
+    if (!blob_valid_hash(hash)) {
+        reply(sock, "ERR bad request\n");
+        return;
+    }
+    snprintf(path, sizeof(path), "%s/%s", BLOB_DIR, hash);
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) < 0) {
+        if (fd >= 0) close(fd);
+        reply(sock, "ERR not found\n");
+        return;
+    }
+
+    long size = st.st_size;
+    if (offset < 0 || offset > size) offset = 0;
+    sprintf(msg, "SIZE %ld\n", size);
+    reply(sock, msg);
+
+    // Zero-copy from the page cache straight to the socket
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    off_t off = offset;
+    while (off < size) {
+        size_t want = size - off < TRANSFER_CHUNK ? size - off : TRANSFER_CHUNK;
+        ssize_t n = sendfile(sock, fd, &off, want);
+        if (n <= 0) break;
+        pace(&start, off - offset);
+    }
+    close(fd);
+}
@@ -0,0 +1,24 @@
+#ifndef BLOB_STORE_H
+#define BLOB_STORE_H
+
+#define BLOB_DIR "blobs"
+#define BLOB_HASH_LEN 64                  // Hex SHA-256
+#define MAX_BLOB_SIZE (64L * 1024 * 1024)
+#define TRANSFER_CHUNK (64 * 1024)
+#define TRANSFER_RATE (4L * 1024 * 1024)  // Bytes/sec per transfer connection
+#define MAX_ACTIVE_UPLOADS 16
+#define MAX_BLOB_STORE (1024L * 1024 * 1024) // Total bytes on disk, .part files included
+#define BLOB_PART_TTL (24 * 60 * 60)         // Seconds an untouched .part is kept for a resume
+
+// Blobs are stored as BLOB_DIR/<sha256>; partial uploads as <sha256>.part
+int blob_valid_hash(const char *hash);
+long blob_size(const char *hash); // -1 if not stored
+
+// Both run on a dedicated transfer connection and block until done.
+// Upload replies "OFFSET <n>\n" (bytes already held), reads the rest, then
+// "OK\n" or "ERR <reason>\n"; "ERR quota\n" if the store has no room for it. Download replies "SIZE <n>\n" then the bytes
+// from 'offset' on.
+void blob_upload(int sock, const char *hash, long size);
+void blob_download(int sock, const char *hash, long offset);
+
+#endif
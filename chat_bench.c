@@ -0,0 +1,380 @@
+// chat_bench.c - Microbenchmarks for chat_db and room_log primitives
+// Compile: gcc -O2 chat_bench.c chat_db.c room_log.c fanout.c uring.c -o chat_bench -pthread -lz
+// Run:     ./chat_bench [max_threads] > bench_output.txt   (JSON, one result per primitive/size)
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <sched.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <sys/socket.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <sys/ptrace.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#include <signal.h>
+#include "chat_db.h"
+#include "room_log.h"
+#include "fanout.h"
+#include "uring.h"
+
+#define MIN_BENCH_NS 200000000L // Run each case for at least 0.2s
+#define MAX_ITERATIONS 1000000L
+#define FANOUT_ROUNDS 500 // Broadcasts per room size / thread count
+#define SAMPLED_ITERATIONS 100000 // Individually timed calls, for the p99
+#define SYSCALL_ITERATIONS 1000   // Calls run under ptrace to count syscalls
+
+static int first_result = 1;
+
+static long now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000L + ts.tv_nsec;
+}
+
+static void report(const char *name, long size, long iterations, long elapsed_ns) {
+    printf("%s\n    {\"name\": \"%s\", \"size\": %ld, \"iterations\": %ld, \"ns_per_op\": %.1f}",
+           first_result ? "" : ",", name, size, iterations, (double)elapsed_ns / iterations);
+    first_result = 0;
+    fflush(stdout);
+}
+
+// Repeats fn until MIN_BENCH_NS has passed (or max_iterations), then reports
+static void run_bench(const char *name, long size, void (*fn)(long i), long max_iterations) {
+    long start = now_ns(), i = 0;
+    while (i < max_iterations && (i == 0 || now_ns() - start < MIN_BENCH_NS)) fn(i++);
+    report(name, size, i, now_ns() - start);
+}
+
+static int compare_long(const void *a, const void *b) {
+    long x = *(const long *)a, y = *(const long *)b;
+    return (x > y) - (x < y);
+}
+
+// Runs fn 'iterations' times in a child traced with ptrace and returns the
+// syscalls per call. getppid() brackets the measured loop. Single-threaded
+// code only: threads the child would need are not forked with it.
+static double count_syscalls(void (*fn)(long i), long iterations) {
+    fflush(stdout);
+    pid_t child = fork();
+    if (child == 0) {
+        ptrace(PTRACE_TRACEME, 0, NULL, NULL);
+        raise(SIGSTOP);
+        getppid();
+        for (long i = 0; i < iterations; i++) fn(i);
+        getppid();
+        _exit(0);
+    }
+
+    int status, markers = 0, sig = 0;
+    long count = 0;
+    waitpid(child, &status, 0);
+    ptrace(PTRACE_SETOPTIONS, child, NULL, PTRACE_O_TRACESYSGOOD | PTRACE_O_EXITKILL);
+    while (markers < 2) {
+        ptrace(PTRACE_SYSCALL, child, NULL, sig);
+        sig = 0;
+        if (waitpid(child, &status, 0) < 0 || !WIFSTOPPED(status)) break;
+        if (WSTOPSIG(status) != (SIGTRAP | 0x80)) {
+            sig = WSTOPSIG(status); // Not a syscall stop; pass the signal on
+            continue;
+        }
+        struct __ptrace_syscall_info info;
+        if (ptrace(PTRACE_GET_SYSCALL_INFO, child, sizeof(info), &info) <= 0 ||
+            info.op != PTRACE_SYSCALL_INFO_ENTRY) continue;
+        if (info.entry.nr == SYS_getppid) markers++;
+        else if (markers == 1) count++;
+    }
+    kill(child, SIGKILL);
+    waitpid(child, &status, 0);
+    return markers == 2 ? (double)count / iterations : -1;
+}
+
+// Times each call on its own for the p99, then counts its syscalls
+static long op_samples[SAMPLED_ITERATIONS];
+static void run_sampled(const char *name, const char *backend, void (*fn)(long i)) {
+    long total = 0;
+    for (long i = 0; i < SAMPLED_ITERATIONS; i++) {
+        long start = now_ns();
+        fn(i);
+        op_samples[i] = now_ns() - start;
+        total += op_samples[i];
+    }
+    qsort(op_samples, SAMPLED_ITERATIONS, sizeof(long), compare_long);
+    double syscalls = count_syscalls(fn, SYSCALL_ITERATIONS);
+    printf("%s\n    {\"name\": \"%s\", \"backend\": \"%s\", \"size\": 1, \"iterations\": %d, "
+           "\"ns_per_op\": %.1f, \"p99_ns\": %ld, \"syscalls_per_op\": %.2f}",
+           first_result ? "" : ",", name, backend, SAMPLED_ITERATIONS, (double)total / SAMPLED_ITERATIONS,
+           op_samples[SAMPLED_ITERATIONS * 99 / 100], syscalls);
+    first_result = 0;
+    fflush(stdout);
+}
+
+// --- LIST HELPERS ---
+static char list_without[2048], list_with[2048], bench_list[2048];
+static char bench_probe[16];
+
+// list_with holds user000..user<n-1>; list_without lacks the last one
+static void build_list(long n) {
+    list_with[0] = '\0';
+    for (long i = 0; i < n; i++) {
+        char name[16];
+        snprintf(name, sizeof(name), "user%03ld", i % 1000);
+        if (i == n - 1) {
+            strcpy(list_without, list_with);
+            strcpy(bench_probe, name); // Worst case: last entry
+        }
+        add_to_list(list_with, name);
+    }
+}
+
+static void bench_is_in_list(long i) { is_in_list(list_with, bench_probe); }
+static void bench_add_to_list(long i) {
+    strcpy(bench_list, list_without);
+    add_to_list(bench_list, bench_probe);
+}
+static void bench_remove_from_list(long i) {
+    strcpy(bench_list, list_with);
+    remove_from_list(bench_list, bench_probe);
+}
+
+// --- GROUPS ---
+static void fill_groups(long n) {
+    group_count = 0;
+    for (long i = 0; i < n; i++) {
+        Group *g = &groups[group_count++];
+        g->id = 100 + i;
+        sprintf(g->name, "group%ld", i);
+        strcpy(g->admins, "alice");
+        strcpy(g->members, "alice,bob,carol");
+        strcpy(g->banned, "mallory");
+    }
+}
+
+static void bench_save_groups(long i) { save_groups(); }
+static void bench_load_groups_text(long i) { parse_groups_text(); } // Parse only, no snapshot conversion
+static void bench_load_snapshot(long i) { load_snapshot(); }
+
+// --- USERS ---
+static char bench_user[50];
+
+static void write_users(long n) {
+    FILE *f = fopen(DB_USERS, "w");
+    for (long i = 0; i < n; i++) fprintf(f, "user%ld pass%ld\n", i, i);
+    fclose(f);
+    sprintf(bench_user, "user%ld", n - 1); // Worst case for the text scan
+}
+
+static void bench_login_user(long i) { login_user(bench_user, "wrong"); }
+static void bench_register_user(long i) { register_user(bench_user, "taken"); } // Duplicate: full scan, no write
+
+// --- ROOM LOG ---
+static int sock_pair[2];
+static const char *bench_message = "alice: the quick brown fox jumps over the lazy dog";
+
+static void bench_save_message(long i) { save_message_to_file(1, bench_message); }
+// The append path room_log replaced (fopen/fprintf/fclose per message), kept as a baseline
+static void bench_save_message_stdio(long i) {
+    pthread_mutex_lock(&file_mutex);
+    FILE *f = fopen("chat_gaming.txt", "a");
+    if (f) {
+        fprintf(f, "%s\n", bench_message);
+        fclose(f);
+    }
+    pthread_mutex_unlock(&file_mutex);
+}
+static void bench_send_history(long i) { send_history_to_client(sock_pair[0], 2); }
+
+static void *drain_socket(void *arg) {
+    char buf[65536];
+    while (recv(sock_pair[1], buf, sizeof(buf), 0) > 0);
+    return NULL;
+}
+
+// --- FAN-OUT ---
+static volatile int fanout_draining;
+static atomic_long fanout_received;     // Bytes read across all receivers
+static atomic_long fanout_expected;     // Total bytes once the current broadcast has landed
+static atomic_long fanout_delivered_at; // Set by whichever drain thread reads the last copy
+
+// Receivers are split across as many epoll drain threads as there are sending
+// threads, so reading the copies never caps the senders being measured. Each
+// pass adds what it read to the total and stamps the moment it is complete.
+static void *drain_room(void *arg) {
+    int ep = *(int *)arg;
+    struct epoll_event ev[256];
+    char buf[65536];
+    while (fanout_draining) {
+        int n = epoll_wait(ep, ev, 256, 10);
+        if (n <= 0) continue;
+        long bytes = 0;
+        for (int i = 0; i < n; i++) {
+            ssize_t got;
+            while ((got = recv(ev[i].data.fd, buf, sizeof(buf), MSG_DONTWAIT)) > 0) bytes += got;
+        }
+        long zero = 0;
+        if (atomic_fetch_add(&fanout_received, bytes) + bytes >= atomic_load(&fanout_expected))
+            atomic_compare_exchange_strong(&fanout_delivered_at, &zero, now_ns());
+    }
+    return NULL;
+}
+
+static const int *fanout_fds;
+static int fanout_count;
+static void bench_fanout_once(long i) { fanout_send(fanout_fds, fanout_count, bench_message, strlen(bench_message)); }
+
+// Time from the start of a broadcast until every recipient has read its copy
+static void bench_fanout(int room_size, int threads, int uring) {
+    int *senders = malloc(sizeof(int) * room_size), *receivers = malloc(sizeof(int) * room_size);
+    int eps[FANOUT_MAX_WORKERS + 1];
+    for (int d = 0; d < threads; d++) eps[d] = epoll_create1(0);
+    for (int i = 0; i < room_size; i++) {
+        int sv[2];
+        socketpair(AF_UNIX, SOCK_STREAM, 0, sv);
+        senders[i] = sv[0];
+        receivers[i] = sv[1];
+        struct epoll_event ev = { .events = EPOLLIN, .data.fd = sv[1] };
+        epoll_ctl(eps[i % threads], EPOLL_CTL_ADD, sv[1], &ev);
+    }
+
+    fanout_draining = 1;
+    atomic_store(&fanout_received, 0);
+    atomic_store(&fanout_expected, 0);
+    atomic_store(&fanout_delivered_at, 0);
+    pthread_t drains[FANOUT_MAX_WORKERS + 1];
+    for (int d = 0; d < threads; d++) pthread_create(&drains[d], NULL, drain_room, &eps[d]);
+    io_backend_set(uring);
+    fanout_init(threads - 1);
+
+    size_t len = strlen(bench_message);
+    long samples[FANOUT_ROUNDS], total = 0;
+    for (int r = 0; r < FANOUT_ROUNDS; r++) {
+        atomic_store(&fanout_delivered_at, 0);
+        atomic_store(&fanout_expected, (long)(r + 1) * room_size * len);
+        long start = now_ns();
+        fanout_send(senders, room_size, bench_message, len);
+        while (atomic_load(&fanout_delivered_at) == 0) sched_yield();
+        samples[r] = atomic_load(&fanout_delivered_at) - start;
+        total += samples[r];
+    }
+
+    // Only countable without pool threads (serial, or batched through io_uring)
+    double syscalls = -1;
+    if (threads == 1) {
+        fanout_fds = senders;
+        fanout_count = room_size;
+        syscalls = count_syscalls(bench_fanout_once, 100);
+    }
+
+    fanout_shutdown();
+    io_backend_set(0);
+    fanout_draining = 0;
+    for (int d = 0; d < threads; d++) pthread_join(drains[d], NULL);
+    for (int i = 0; i < room_size; i++) {
+        close(senders[i]);
+        close(receivers[i]);
+    }
+    for (int d = 0; d < threads; d++) close(eps[d]);
+    free(senders);
+    free(receivers);
+
+    qsort(samples, FANOUT_ROUNDS, sizeof(long), compare_long);
+    printf(",\n    {\"name\": \"fanout_send\", \"backend\": \"%s\", \"size\": %d, \"threads\": %d, \"iterations\": %d, "
+           "\"ns_per_op\": %.1f, \"p99_delivery_ns\": %ld",
+           uring ? "uring" : "posix", room_size, threads, FANOUT_ROUNDS, (double)total / FANOUT_ROUNDS,
+           samples[FANOUT_ROUNDS * 99 / 100]);
+    if (syscalls >= 0) printf(", \"syscalls_per_op\": %.2f", syscalls);
+    printf("}");
+    fflush(stdout);
+}
+
+int main(int argc, char *argv[]) {
+    long max_threads = argc > 1 ? atol(argv[1]) : sysconf(_SC_NPROCESSORS_ONLN);
+    if (max_threads < 1) max_threads = 1;
+    if (max_threads > FANOUT_MAX_WORKERS + 1) max_threads = FANOUT_MAX_WORKERS + 1;
+
+    // Work in a scratch directory so real data files are never touched
+    char dir[] = "/tmp/chat_bench_XXXXXX";
+    if (!mkdtemp(dir) || chdir(dir) != 0) {
+        perror("chat_bench");
+        return 1;
+    }
+
+    printf("{\n  \"benchmarks\": [");
+
+    long list_sizes[] = { 4, 16, 64, 200 }; // Lists live in fixed 2048-byte fields
+    for (int s = 0; s < 4; s++) {
+        build_list(list_sizes[s]);
+        run_bench("is_in_list", list_sizes[s], bench_is_in_list, MAX_ITERATIONS);
+        run_bench("add_to_list", list_sizes[s], bench_add_to_list, MAX_ITERATIONS);
+        run_bench("remove_from_list", list_sizes[s], bench_remove_from_list, MAX_ITERATIONS);
+    }
+
+    long group_sizes[] = { 10, 50, MAX_GROUPS }; // Group storage is capped at MAX_GROUPS
+    for (int s = 0; s < 3; s++) {
+        fill_groups(group_sizes[s]);
+        run_bench("save_groups", group_sizes[s], bench_save_groups, 10000);
+        run_bench("load_groups_text", group_sizes[s], bench_load_groups_text, 10000);
+        save_snapshot();
+        run_bench("load_snapshot", group_sizes[s], bench_load_snapshot, 10000);
+    }
+
+    long user_counts[] = { 100, 1000, 10000, 100000 };
+    for (int s = 0; s < 4; s++) {
+        remove(DB_SNAPSHOT);
+        write_users(user_counts[s]);
+        run_bench("login_user_text", user_counts[s], bench_login_user, 10000);
+        run_bench("register_user_text", user_counts[s], bench_register_user, 10000);
+        save_snapshot();
+        load_snapshot();
+        run_bench("login_user_snapshot", user_counts[s], bench_login_user, MAX_ITERATIONS);
+        run_bench("register_user_snapshot", user_counts[s], bench_register_user, MAX_ITERATIONS);
+    }
+
+    socketpair(AF_UNIX, SOCK_STREAM, 0, sock_pair);
+    pthread_t drain;
+    pthread_create(&drain, NULL, drain_socket, NULL);
+
+    run_sampled("save_message_stdio", "posix", bench_save_message_stdio);
+    run_sampled("save_message_to_file", "posix", bench_save_message);
+    io_backend_set(1);
+    if (io_backend_uring()) run_sampled("save_message_to_file", "uring", bench_save_message);
+    io_backend_set(0);
+    long history_sizes[] = { 10, 100 }; // Replay is paced at ~1ms per line
+    for (int s = 0; s < 2; s++) {
+        char filename[50];
+        get_filename(2, filename);
+        close_room_logs(); // Drop the cached handle before replacing the file
+        remove(filename);
+        for (long i = 0; i < history_sizes[s]; i++) save_message_to_file(2, bench_message);
+        run_bench("send_history_to_client", history_sizes[s], bench_send_history, 1000);
+    }
+
+    shutdown(sock_pair[0], SHUT_RDWR);
+    pthread_join(drain, NULL);
+    close_room_logs();
+
+    // Room sizes are bounded by the fd limit (two fds per member)
+    struct rlimit rl;
+    getrlimit(RLIMIT_NOFILE, &rl);
+    int room_sizes[] = { 32, 64, 256, 1024, 4096 };
+    for (int s = 0; s < 5; s++) {
+        if ((rlim_t)room_sizes[s] * 2 + 64 > rl.rlim_cur) break;
+        // Rooms under FANOUT_THRESHOLD never use the pool; extra threads would only time serial again
+        int threads = room_sizes[s] < FANOUT_THRESHOLD ? 1 : max_threads;
+        for (int t = 1; t <= threads; t *= 2) bench_fanout(room_sizes[s], t, 0);
+        io_backend_set(1);
+        if (io_backend_uring()) bench_fanout(room_sizes[s], 1, 1);
+        io_backend_set(0);
+    }
+
+    printf("\n  ]\n}\n");
+
+    const char *scratch[] = { DB_USERS, DB_GROUPS, DB_SNAPSHOT, "chat_general.txt", "chat_study.txt", "chat_gaming.txt" };
+    for (int i = 0; i < 6; i++) remove(scratch[i]);
+    rmdir(dir);
+    return 0;
+}
@@ -1,11 +1,44 @@
+#define _GNU_SOURCE // PTHREAD_RECURSIVE_MUTEX_INITIALIZER_NP
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include "chat_db.h"
 
 Group groups[MAX_GROUPS];
 int group_count = 0;
 
+// Guards groups[]/group_count and the files written from them. Recursive
+// because group functions call each other (ban_user -> kick_user -> save_groups).
+pthread_mutex_t groups_mutex = PTHREAD_RECURSIVE_MUTEX_INITIALIZER_NP;
+static unsigned long groups_generation = 0; // Bumped under groups_mutex on every change
+
+// Serializes snapshot writers (they share the .tmp file); never held with groups_mutex
+static pthread_mutex_t snapshot_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+// Boot snapshot mapping (read-only, used in place)
+static void *snap_map = NULL;
+static size_t snap_size = 0;
+static const UserRecord *snap_users = NULL;
+static unsigned int snap_user_count = 0;
+
+static int compare_users(const void *a, const void *b) {
+    return strcmp(((const UserRecord *)a)->name, ((const UserRecord *)b)->name);
+}
+
+static const UserRecord *find_snapshot_user(const char *username) {
+    if (!snap_users) return NULL;
+    UserRecord key;
+    snprintf(key.name, sizeof(key.name), "%s", username);
+    return bsearch(&key, snap_users, snap_user_count, sizeof(UserRecord), compare_users);
+}
+
 // --- AUTHENTICATION ---
 
 int register_user(const char *username, const char *password) {
+    if (find_snapshot_user(username)) return 0; // User exists
+
     FILE *f = fopen(DB_USERS, "a+");
     if (!f) return 0;
 
@@ -24,6 +57,11 @@ int register_user(const char *username, const char *password) {
 }
 
 int login_user(const char *username, const char *password) {
+    // Users in the snapshot are answered from the mapping. Anyone registered
+    // since it was written is still found by scanning the text file.
+    const UserRecord *rec = find_snapshot_user(username);
+    if (rec) return strcmp(rec->password, password) == 0;
+
     FILE *f = fopen(DB_USERS, "r");
     if (!f) return 0;
 
@@ -75,20 +113,32 @@ void remove_from_list(char *list, const char *name) {
 // --- GROUP MANAGEMENT ---
 
 void save_groups() {
+    pthread_mutex_lock(&groups_mutex);
+    groups_generation++; // Every mutation persists through here
     FILE *f = fopen(DB_GROUPS, "w");
-    if (!f) return;
-    for (int i = 0; i < group_count; i++) {
-        // Format: ID|Name|Admins|Members|Banned
-        fprintf(f, "%d|%s|%s|%s|%s\n", groups[i].id, groups[i].name, 
-                groups[i].admins, groups[i].members, groups[i].banned);
+    if (f) {
+        for (int i = 0; i < group_count; i++) {
+            // Format: ID|Name|Admins|Members|Banned
+            fprintf(f, "%d|%s|%s|%s|%s\n", groups[i].id, groups[i].name, 
+                    groups[i].admins, groups[i].members, groups[i].banned);
+        }
+        fclose(f);
     }
-    fclose(f);
+    pthread_mutex_unlock(&groups_mutex);
 }
 
 void load_groups() {
+    if (load_snapshot()) return;
+
+    if (parse_groups_text()) save_snapshot(); // First run: convert the text files
+}
+
+int parse_groups_text() {
     FILE *f = fopen(DB_GROUPS, "r");
-    if (!f) return;
+    if (!f) return 0;
     
+    pthread_mutex_lock(&groups_mutex);
+    groups_generation++;
     group_count = 0;
     char line[4096];
     while (fgets(line, sizeof(line), f)) {
@@ -112,96 +162,267 @@ void load_groups() {
         group_count++;
     }
     fclose(f);
+    pthread_mutex_unlock(&groups_mutex);
+    return 1;
 }
 
 int create_group(const char *name, const char *creator) {
-    if (group_count >= MAX_GROUPS) return -1;
+    pthread_mutex_lock(&groups_mutex);
+    int id = -1;
+    int exists = 0;
     
     // Check duplication
     for(int i=0; i<group_count; i++) {
-        if(strcmp(groups[i].name, name) == 0) return -1;
+        if(strcmp(groups[i].name, name) == 0) exists = 1;
     }
 
-    Group *g = &groups[group_count];
-    g->id = 100 + group_count; // Custom groups start at 100
-    strcpy(g->name, name);
-    strcpy(g->admins, creator);
-    strcpy(g->members, creator);
-    strcpy(g->banned, "");
-    
-    group_count++;
-    save_groups();
-    return g->id;
+    if (!exists && group_count < MAX_GROUPS) {
+        Group *g = &groups[group_count];
+        g->id = 100 + group_count; // Custom groups start at 100
+        strcpy(g->name, name);
+        strcpy(g->admins, creator);
+        strcpy(g->members, creator);
+        strcpy(g->banned, "");
+        
+        group_count++;
+        save_groups();
+        id = g->id;
+    }
+    pthread_mutex_unlock(&groups_mutex);
+    return id;
 }
 
 int join_group(int group_id, const char *username) {
+    pthread_mutex_lock(&groups_mutex);
+    int result = 0; // Not found
     for (int i = 0; i < group_count; i++) {
         if (groups[i].id == group_id) {
-            if (is_in_list(groups[i].banned, username)) return 0; // Banned
-            add_to_list(groups[i].members, username);
-            save_groups();
-            return 1;
+            if (!is_in_list(groups[i].banned, username)) { // Banned -> 0
+                add_to_list(groups[i].members, username);
+                save_groups();
+                result = 1;
+            }
+            break;
         }
     }
-    return 0; // Not found
+    pthread_mutex_unlock(&groups_mutex);
+    return result;
 }
 
 int is_admin(int group_id, const char *username) {
+    pthread_mutex_lock(&groups_mutex);
+    int result = 0;
     for (int i = 0; i < group_count; i++) {
         if (groups[i].id == group_id) {
-            return is_in_list(groups[i].admins, username);
+            result = is_in_list(groups[i].admins, username);
+            break;
         }
     }
-    return 0;
+    pthread_mutex_unlock(&groups_mutex);
+    return result;
 }
 
 void kick_user(int group_id, const char *username) {
+    pthread_mutex_lock(&groups_mutex);
     for (int i = 0; i < group_count; i++) {
         if (groups[i].id == group_id) {
             remove_from_list(groups[i].members, username);
             remove_from_list(groups[i].admins, username); // Also remove admin role
             save_groups();
-            return;
+            break;
         }
     }
+    pthread_mutex_unlock(&groups_mutex);
 }
 
 void ban_user(int group_id, const char *username) {
+    pthread_mutex_lock(&groups_mutex);
     for (int i = 0; i < group_count; i++) {
         if (groups[i].id == group_id) {
             kick_user(group_id, username);
             add_to_list(groups[i].banned, username);
             save_groups();
-            return;
+            break;
         }
     }
+    pthread_mutex_unlock(&groups_mutex);
 }
 
 void make_admin(int group_id, const char *username) {
+    pthread_mutex_lock(&groups_mutex);
     for (int i = 0; i < group_count; i++) {
         if (groups[i].id == group_id) {
             add_to_list(groups[i].admins, username);
             save_groups();
         }
     }
+    pthread_mutex_unlock(&groups_mutex);
 }
 
 int get_group_id_by_name(const char *name) {
+    pthread_mutex_lock(&groups_mutex);
+    int id = -1;
     for (int i = 0; i < group_count; i++) {
-        if (strcmp(groups[i].name, name) == 0) return groups[i].id;
+        if (strcmp(groups[i].name, name) == 0) { id = groups[i].id; break; }
     }
-    return -1;
+    pthread_mutex_unlock(&groups_mutex);
+    return id;
+}
+
+int group_exists(int group_id) {
+    pthread_mutex_lock(&groups_mutex);
+    int found = 0;
+    for (int i = 0; i < group_count; i++) {
+        if (groups[i].id == group_id) { found = 1; break; }
+    }
+    pthread_mutex_unlock(&groups_mutex);
+    return found;
+}
+
+int list_group_ids(int *ids, int max) {
+    pthread_mutex_lock(&groups_mutex);
+    int n = group_count < max ? group_count : max;
+    for (int i = 0; i < n; i++) ids[i] = groups[i].id;
+    pthread_mutex_unlock(&groups_mutex);
+    return n;
 }
 
 int delete_group(int group_id) {
+    pthread_mutex_lock(&groups_mutex);
+    int result = 0;
     for (int i = 0; i < group_count; i++) {
         if (groups[i].id == group_id) {
             // Simple deletion: swap with last
             groups[i] = groups[group_count - 1];
             group_count--;
             save_groups();
-            return 1;
+            result = 1;
+            break;
         }
     }
-    return 0;
-}
\ No newline at end of file
+    pthread_mutex_unlock(&groups_mutex);
+    return result;
+}
+
+// --- SNAPSHOT ---
+
+int load_snapshot() {
+    int fd = open(DB_SNAPSHOT, O_RDONLY);
+    if (fd < 0) return 0;
+
+    struct stat st;
+    if (fstat(fd, &st) < 0 || (size_t)st.st_size < sizeof(SnapshotHeader)) {
+        close(fd);
+        return 0;
+    }
+    void *map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) return 0;
+
+    const SnapshotHeader *h = (const SnapshotHeader *)map;
+    size_t expected = sizeof(SnapshotHeader) + (size_t)h->group_count * sizeof(Group)
+                    + (size_t)h->user_count * sizeof(UserRecord);
+    if (memcmp(h->magic, SNAPSHOT_MAGIC, 4) != 0 || h->version != SNAPSHOT_VERSION ||
+        h->group_size != sizeof(Group) || h->user_size != sizeof(UserRecord) ||
+        h->group_count > MAX_GROUPS || expected != (size_t)st.st_size) {
+        munmap(map, st.st_size);
+        return 0;
+    }
+
+    if (snap_map) munmap(snap_map, snap_size);
+    snap_map = map;
+    snap_size = st.st_size;
+    const Group *snap_groups = (const Group *)(h + 1);
+    snap_users = (const UserRecord *)(snap_groups + h->group_count);
+    snap_user_count = h->user_count;
+
+    // groups.txt edited after the snapshot was taken wins, ties included
+    struct stat gst;
+    if (stat(DB_GROUPS, &gst) == 0 &&
+        (gst.st_mtim.tv_sec > st.st_mtim.tv_sec ||
+         (gst.st_mtim.tv_sec == st.st_mtim.tv_sec && gst.st_mtim.tv_nsec >= st.st_mtim.tv_nsec))) {
+        return 0;
+    }
+
+    // Groups are mutated at runtime, so they are copied out of the mapping
+    pthread_mutex_lock(&groups_mutex);
+    memcpy(groups, snap_groups, h->group_count * sizeof(Group));
+    group_count = h->group_count;
+    groups_generation++;
+    pthread_mutex_unlock(&groups_mutex);
+    return 1;
+}
+
+int save_snapshot() {
+    UserRecord *users = NULL;
+    unsigned int user_count = 0, cap = 0;
+
+    FILE *uf = fopen(DB_USERS, "r");
+    if (uf) {
+        UserRecord r;
+        memset(&r, 0, sizeof(r));
+        while (fscanf(uf, "%49s %49s", r.name, r.password) == 2) {
+            if (user_count == cap) {
+                cap = cap ? cap * 2 : 64;
+                UserRecord *grown = realloc(users, cap * sizeof(UserRecord));
+                if (!grown) { free(users); fclose(uf); return 0; }
+                users = grown;
+            }
+            users[user_count++] = r;
+            memset(&r, 0, sizeof(r));
+        }
+        fclose(uf);
+    }
+    if (user_count) qsort(users, user_count, sizeof(UserRecord), compare_users);
+
+    // Copy groups[] and write outside groups_mutex, so group chat never waits
+    // on the disk. A mutation since the copy means the copy is stale, so it
+    // is not published; the next refresh is.
+    Group *copy = malloc(sizeof(Group) * MAX_GROUPS);
+    if (!copy) { free(users); return 0; }
+    pthread_mutex_lock(&groups_mutex);
+    unsigned int copied = group_count;
+    unsigned long generation = groups_generation;
+    memcpy(copy, groups, copied * sizeof(Group));
+    pthread_mutex_unlock(&groups_mutex);
+
+    SnapshotHeader h;
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, SNAPSHOT_MAGIC, 4);
+    h.version = SNAPSHOT_VERSION;
+    h.group_count = copied;
+    h.user_count = user_count;
+    h.group_size = sizeof(Group);
+    h.user_size = sizeof(UserRecord);
+
+    // Write aside and rename so a crash never leaves a torn snapshot
+    pthread_mutex_lock(&snapshot_mutex);
+    FILE *f = fopen(DB_SNAPSHOT ".tmp", "wb");
+    int ok = f != NULL;
+    if (f) {
+        ok = fwrite(&h, sizeof(h), 1, f) == 1 &&
+             fwrite(copy, sizeof(Group), copied, f) == copied &&
+             fwrite(users, sizeof(UserRecord), user_count, f) == user_count;
+        ok = (fclose(f) == 0) && ok;
+    }
+    free(copy);
+    free(users);
+
+    if (ok) {
+        pthread_mutex_lock(&groups_mutex);
+        ok = generation == groups_generation;
+        pthread_mutex_unlock(&groups_mutex);
+    }
+    ok = ok && rename(DB_SNAPSHOT ".tmp", DB_SNAPSHOT) == 0;
+    if (!ok) remove(DB_SNAPSHOT ".tmp");
+
+    // A mutation that slipped in before the rename may have written groups.txt
+    // first. Rewrite it so it is no older than the snapshot and wins at boot.
+    if (ok) {
+        pthread_mutex_lock(&groups_mutex);
+        if (generation != groups_generation) save_groups();
+        pthread_mutex_unlock(&groups_mutex);
+    }
+    pthread_mutex_unlock(&snapshot_mutex);
+    return ok;
+}
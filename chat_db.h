@@ -8,6 +8,10 @@
 #define MAX_GROUPS 100
 #define DB_USERS "users.txt"
 #define DB_GROUPS "groups.txt"
+#define DB_SNAPSHOT "chat_db.snap"
+
+#define SNAPSHOT_MAGIC "CHSN"
+#define SNAPSHOT_VERSION 1
 
 typedef struct {
     int id;
@@ -17,6 +21,22 @@ typedef struct {
     char banned[1024];  // Comma separated usernames
 } Group;
 
+// Binary snapshot layout: header, Group[group_count], UserRecord[user_count].
+// Users are sorted by name so logins can bsearch the mapping in place.
+typedef struct {
+    char magic[4];
+    unsigned int version;
+    unsigned int group_count;
+    unsigned int user_count;
+    unsigned int group_size;
+    unsigned int user_size;
+} SnapshotHeader;
+
+typedef struct {
+    char name[50];
+    char password[50];
+} UserRecord;
+
 // Global group storage
 extern Group groups[MAX_GROUPS];
 extern int group_count;
@@ -35,9 +55,18 @@ void kick_user(int group_id, const char *username);
 void ban_user(int group_id, const char *username);
 void make_admin(int group_id, const char *username);
 int get_group_id_by_name(const char *name);
+int group_exists(int group_id);
+int list_group_ids(int *ids, int max); // Copies current group ids, returns count
 int delete_group(int group_id);
 
+// Snapshot Functions
+int load_snapshot();  // Maps DB_SNAPSHOT; returns 1 if groups were loaded from it
+int save_snapshot();  // Rewrites DB_SNAPSHOT from a copy of groups[] and DB_USERS; 0 if not published
+int parse_groups_text(); // Fills groups[] from DB_GROUPS only; used by load_groups
+
 // Helper to check if a user string is in a comma-separated list
 int is_in_list(const char *list, const char *name);
+void add_to_list(char *list, const char *name);
+void remove_from_list(char *list, const char *name);
 
 #endif
\ No newline at end of file
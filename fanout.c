@@ -0,0 +1,168 @@
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <sys/socket.h>
+#include "fanout.h"
+#include "uring.h"
+
+// io_uring backend: one batched submission per broadcast instead of a
+// send() per recipient. Used under job_mutex; replaces the worker pool.
+static Uring send_ring;
+static int use_ring = 0;
+
+static pthread_t workers[FANOUT_MAX_WORKERS];
+static int worker_count = 0;
+static int stopping = 0;
+
+static pthread_mutex_t pool_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t work_cond = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t done_cond = PTHREAD_COND_INITIALIZER;
+static unsigned long generation = 0; // Bumped per broadcast, never reset
+static unsigned long start_generation = 0; // generation when the pool was (re)started
+static int busy = 0;                 // Workers still on the current broadcast
+
+static pthread_mutex_t job_mutex = PTHREAD_MUTEX_INITIALIZER; // One broadcast at a time
+static struct {
+    const int *fds;
+    int count;
+    const char *msg;
+    size_t len;
+    atomic_int next; // Next unclaimed recipient
+} job;
+
+// Threads claim small batches off a shared cursor, so one slow socket only
+// delays its own batch while the others are picked up by idle threads.
+static void drain_job() {
+    int start;
+    while ((start = atomic_fetch_add(&job.next, FANOUT_BATCH)) < job.count) {
+        int end = start + FANOUT_BATCH < job.count ? start + FANOUT_BATCH : job.count;
+        for (int i = start; i < end; i++) send(job.fds[i], job.msg, job.len, MSG_NOSIGNAL);
+    }
+}
+
+static void *fanout_worker(void *arg) {
+    pthread_mutex_lock(&pool_mutex);
+    // Not generation itself: a broadcast may already be waiting on this
+    // worker by the time it first runs
+    unsigned long seen = start_generation;
+    while (1) {
+        while (generation == seen && !stopping) pthread_cond_wait(&work_cond, &pool_mutex);
+        if (stopping) break;
+        seen = generation;
+        pthread_mutex_unlock(&pool_mutex);
+
+        drain_job();
+
+        pthread_mutex_lock(&pool_mutex);
+        if (--busy == 0) pthread_cond_signal(&done_cond);
+    }
+    pthread_mutex_unlock(&pool_mutex);
+    return NULL;
+}
+
+void fanout_init(int count) {
+    if (io_backend_uring() && uring_init(&send_ring, URING_ENTRIES) == 0) {
+        use_ring = 1; // The kernel's io-wq picks up sends that would block
+        return;
+    }
+    if (count > FANOUT_MAX_WORKERS) count = FANOUT_MAX_WORKERS;
+    pthread_mutex_lock(&pool_mutex);
+    stopping = 0;
+    start_generation = generation; // Passes from a previous pool are not ours
+    pthread_mutex_unlock(&pool_mutex);
+    worker_count = 0;
+    for (int i = 0; i < count; i++) {
+        if (pthread_create(&workers[i], NULL, fanout_worker, NULL) != 0) break;
+        worker_count++;
+    }
+}
+
+void fanout_shutdown() {
+    if (use_ring) {
+        pthread_mutex_lock(&job_mutex);
+        uring_exit(&send_ring);
+        use_ring = 0;
+        pthread_mutex_unlock(&job_mutex);
+        return;
+    }
+    pthread_mutex_lock(&pool_mutex);
+    stopping = 1;
+    pthread_cond_broadcast(&work_cond);
+    pthread_mutex_unlock(&pool_mutex);
+    for (int i = 0; i < worker_count; i++) pthread_join(workers[i], NULL);
+    worker_count = 0;
+}
+
+// Caller holds job_mutex. Queues one IORING_OP_SEND per recipient and
+// submits them together, URING_ENTRIES at a time.
+static void send_batched(const int *fds, int count, const char *msg, size_t len) {
+    int done = 0;
+    while (done < count) {
+        int n = 0;
+        struct io_uring_sqe *sqe;
+        while (done + n < count && (sqe = uring_get_sqe(&send_ring))) {
+            sqe->opcode = IORING_OP_SEND;
+            sqe->fd = fds[done + n];
+            sqe->addr = (unsigned long)msg;
+            sqe->len = len;
+            sqe->msg_flags = MSG_NOSIGNAL;
+            n++;
+        }
+        if (uring_submit(&send_ring, n) < 0) break;
+
+        int reaped = 0;
+        while (reaped < n) {
+            struct io_uring_cqe *cqe = uring_peek_cqe(&send_ring);
+            if (!cqe) {
+                if (uring_submit(&send_ring, n - reaped) < 0) break;
+                continue;
+            }
+            uring_cqe_seen(&send_ring); // Failed sends are dropped, as with send()
+            reaped++;
+        }
+        if (reaped < n) break;
+        done += n;
+    }
+    if (done < count) {
+        // The ring failed; its queued SQEs go with it and the rest are sent plainly
+        uring_exit(&send_ring);
+        use_ring = 0;
+        for (int i = done; i < count; i++) send(fds[i], msg, len, MSG_NOSIGNAL);
+    }
+}
+
+void fanout_send(const int *fds, int count, const char *msg, size_t len) {
+    if (use_ring && count > 1) {
+        pthread_mutex_lock(&job_mutex);
+        if (use_ring) {
+            send_batched(fds, count, msg, len);
+            pthread_mutex_unlock(&job_mutex);
+            return;
+        }
+        pthread_mutex_unlock(&job_mutex);
+    }
+    if (count < FANOUT_THRESHOLD || worker_count == 0) {
+        for (int i = 0; i < count; i++) send(fds[i], msg, len, MSG_NOSIGNAL);
+        return;
+    }
+
+    pthread_mutex_lock(&job_mutex);
+    job.fds = fds;
+    job.count = count;
+    job.msg = msg;
+    job.len = len;
+    atomic_store(&job.next, 0);
+
+    pthread_mutex_lock(&pool_mutex);
+    busy = worker_count;
+    generation++;
+    pthread_cond_broadcast(&work_cond);
+    pthread_mutex_unlock(&pool_mutex);
+
+    drain_job(); // The caller works too
+
+    pthread_mutex_lock(&pool_mutex);
+    while (busy > 0) pthread_cond_wait(&done_cond, &pool_mutex);
+    pthread_mutex_unlock(&pool_mutex);
+    pthread_mutex_unlock(&job_mutex);
+}
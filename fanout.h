@@ -0,0 +1,22 @@
+#ifndef FANOUT_H
+#define FANOUT_H
+
+#include <stddef.h>
+
+// Recipients before a broadcast goes parallel. Handing a broadcast to the pool
+// costs ~25us (chat_bench: 2 threads lose to serial at 32 and 64 recipients),
+// so only rooms whose serial send clearly outweighs that are split.
+#define FANOUT_THRESHOLD 256
+#define FANOUT_BATCH 8        // Recipients a thread claims at a time
+#define FANOUT_MAX_WORKERS 8
+
+// Starts 'workers' helper threads (0 keeps every broadcast serial). Must
+// return before the first fanout_send: broadcasts wait on worker_count.
+void fanout_init(int workers);
+void fanout_shutdown();
+
+// Sends msg to every fd and returns once all sends are done. Calls are
+// serialized, so each recipient still sees broadcasts in order.
+void fanout_send(const int *fds, int count, const char *msg, size_t len);
+
+#endif
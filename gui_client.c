@@ -10,17 +10,24 @@
 
 #define PORT 8080
 #define BUFFER_SIZE 4096
+#define HISTORY_CAP 200          // Messages kept per private contact (env CHAT_HISTORY_CAP)
+#define MAX_PRIVATE_SESSIONS 64  // Contacts kept before the least recent is dropped (env CHAT_MAX_SESSIONS)
+#define TRANSFER_CHUNK (64 * 1024)
 
 int sock_fd = 0;
-char username[50];
+char username[50], server_ip[50];
+char auth_user[50], auth_pass[50]; // From the last /login or /register; file transfers resend them
 int current_mode = 0; // 0 = Public, 1 = Private
 char private_target[50] = "";
 
 GtkWidget *message_list_box, *scrolled_window, *entry_msg, *status_label, *title_label, *send_btn, *alert_badge;
 
 typedef struct { char *text; int type; char *sender; } MsgData; // 0=Mine,1=Others,2=Channel,3=Server,4=Private
-typedef struct { char *contact_name; GList *messages; } ChatSession;
-GList *private_sessions = NULL;
+typedef struct { char *text; int type; const char *sender; } HistoryEntry; // sender is interned
+typedef struct { HistoryEntry *ring; guint head, len; gint64 last_used; } ChatSession; // Fixed-size ring, oldest at head
+GHashTable *private_sessions = NULL; // contact name -> ChatSession*
+GMutex history_lock; // Receive thread writes, UI thread reads
+guint history_cap = HISTORY_CAP, max_sessions = MAX_PRIVATE_SESSIONS;
 
 static void load_css() {
     GtkCssProvider *p = gtk_css_provider_new();
@@ -46,16 +53,38 @@ static void load_css() {
     gtk_style_context_add_provider_for_screen(gdk_screen_get_default(), GTK_STYLE_PROVIDER(p), GTK_STYLE_PROVIDER_PRIORITY_APPLICATION);
 }
 
+static void free_session(gpointer p) {
+    ChatSession *s = (ChatSession*)p;
+    for (guint i = 0; i < s->len; i++) g_free(s->ring[(s->head + i) % history_cap].text);
+    g_free(s->ring); g_free(s);
+}
+
+static void evict_oldest_session() {
+    GHashTableIter it; gpointer k, v, oldest = NULL; gint64 t = G_MAXINT64;
+    g_hash_table_iter_init(&it, private_sessions);
+    while (g_hash_table_iter_next(&it, &k, &v)) if (((ChatSession*)v)->last_used < t && strcmp(k, private_target)) { t = ((ChatSession*)v)->last_used; oldest = k; }
+    if (oldest) g_hash_table_remove(private_sessions, oldest);
+}
+
+// Caller holds history_lock
 ChatSession* get_session(const char *c) {
-    for (GList *l = private_sessions; l; l = l->next) if (strcmp(((ChatSession*)l->data)->contact_name, c) == 0) return (ChatSession*)l->data;
-    ChatSession *s = g_malloc(sizeof(ChatSession)); s->contact_name = g_strdup(c); s->messages = NULL;
-    private_sessions = g_list_append(private_sessions, s); return s;
+    if (!private_sessions) private_sessions = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, free_session);
+    ChatSession *s = g_hash_table_lookup(private_sessions, c);
+    if (!s) {
+        if (g_hash_table_size(private_sessions) >= max_sessions) evict_oldest_session();
+        s = g_malloc0(sizeof(ChatSession)); s->ring = g_new0(HistoryEntry, history_cap);
+        g_hash_table_insert(private_sessions, g_strdup(c), s);
+    }
+    s->last_used = g_get_monotonic_time(); return s;
 }
 
 void add_to_history(const char *c, MsgData *m) {
-    ChatSession *s = get_session(c); MsgData *cp = g_malloc(sizeof(MsgData));
-    cp->text = g_strdup(m->text); cp->sender = g_strdup(m->sender); cp->type = m->type;
-    s->messages = g_list_append(s->messages, cp);
+    g_mutex_lock(&history_lock);
+    ChatSession *s = get_session(c); HistoryEntry *e;
+    if (s->len < history_cap) e = &s->ring[(s->head + s->len++) % history_cap];
+    else { e = &s->ring[s->head]; g_free(e->text); s->head = (s->head + 1) % history_cap; } // Full: overwrite oldest
+    e->text = g_strdup(m->text); e->sender = g_intern_string(m->sender); e->type = m->type;
+    g_mutex_unlock(&history_lock);
 }
 
 static void scroll_to_bottom() { 
@@ -68,36 +97,144 @@ void clear_chat_window() {
     g_list_free(c);
 }
 
-static gboolean append_message(gpointer user_data) {
-    MsgData *d = (MsgData *)user_data; if(!d) return FALSE;
-    GtkWidget *row = gtk_box_new(GTK_ORIENTATION_HORIZONTAL, 0), *b = gtk_label_new(d->text);
+static void add_bubble(const char *text, int type, const char *sender) {
+    GtkWidget *row = gtk_box_new(GTK_ORIENTATION_HORIZONTAL, 0), *b = gtk_label_new(text);
     gtk_label_set_line_wrap(GTK_LABEL(b), TRUE); gtk_label_set_max_width_chars(GTK_LABEL(b), 60);
     GtkStyleContext *sc = gtk_widget_get_style_context(b); gtk_style_context_add_class(sc, "bubble");
     
-    if (d->type == 0) { // Mine
+    if (type == 0) { // Mine
         gtk_widget_set_halign(row, GTK_ALIGN_END); gtk_label_set_xalign(GTK_LABEL(b), 0.0);
         gtk_style_context_add_class(sc, "mine"); gtk_box_pack_end(GTK_BOX(row), b, 0, 0, 0);
-    } else if (d->type == 2 || d->type == 3) { // Channel/Server
-        gtk_widget_set_halign(row, GTK_ALIGN_CENTER); gtk_style_context_add_class(sc, d->type == 2 ? "channel" : "server");
+    } else if (type == 2 || type == 3) { // Channel/Server
+        gtk_widget_set_halign(row, GTK_ALIGN_CENTER); gtk_style_context_add_class(sc, type == 2 ? "channel" : "server");
         gtk_box_pack_start(GTK_BOX(row), b, 1, 1, 0);
     } else { // Private or Others
-        if (d->type == 4) gtk_style_context_add_class(sc, "private");
-        if (d->type == 4 && strcmp(d->sender, "Me") == 0) {
+        if (type == 4) gtk_style_context_add_class(sc, "private");
+        if (type == 4 && strcmp(sender, "Me") == 0) {
              gtk_widget_set_halign(row, GTK_ALIGN_END); gtk_style_context_add_class(sc, "mine"); gtk_box_pack_end(GTK_BOX(row), b, 0, 0, 0);
         } else {
              gtk_widget_set_halign(row, GTK_ALIGN_START); gtk_style_context_add_class(sc, "others"); gtk_box_pack_start(GTK_BOX(row), b, 0, 0, 0);
         }
     }
     gtk_container_add(GTK_CONTAINER(message_list_box), row); gtk_widget_show_all(row);
-    g_timeout_add(100, (GSourceFunc)scroll_to_bottom, NULL);
+}
+
+static gboolean append_message(gpointer user_data) {
+    MsgData *d = (MsgData *)user_data; if(!d) return FALSE;
+    add_bubble(d->text, d->type, d->sender); g_timeout_add(100, (GSourceFunc)scroll_to_bottom, NULL);
     g_free(d->text); g_free(d->sender); g_free(d); return FALSE;
 }
 
 void reload_history_for_ui(const char *c) {
-    for (GList *l = get_session(c)->messages; l; l = l->next) {
-        MsgData *s = (MsgData*)l->data, *t = g_malloc(sizeof(MsgData));
-        t->text = g_strdup(s->text); t->sender = g_strdup(s->sender); t->type = s->type; append_message(t);
+    g_mutex_lock(&history_lock); ChatSession *s = get_session(c);
+    for (guint i = 0; i < s->len; i++) { HistoryEntry *e = &s->ring[(s->head + i) % history_cap]; add_bubble(e->text, e->type, e->sender); }
+    g_mutex_unlock(&history_lock); g_timeout_add(100, (GSourceFunc)scroll_to_bottom, NULL);
+}
+
+// --- FILE TRANSFER ---
+// Uploads and downloads run on worker threads over their own connection to the
+// server, so chat keeps flowing; progress reaches the UI through g_idle_add.
+typedef struct { char *sender, *hash, *name; long size; } FileOffer;
+typedef struct { char *path, *target; } UploadJob; // target NULL = current room
+
+static void free_offer(gpointer p) { FileOffer *o = p; g_free(o->sender); g_free(o->hash); g_free(o->name); g_free(o); }
+static gboolean set_status(gpointer t) { gtk_label_set_text(GTK_LABEL(status_label), (char*)t); g_free(t); return FALSE; }
+
+static int open_transfer_socket(const char *cmd) {
+    int fd = socket(AF_INET, SOCK_STREAM, 0); struct sockaddr_in sa; sa.sin_family = AF_INET; sa.sin_port = htons(PORT);
+    if (fd < 0 || inet_pton(AF_INET, server_ip, &sa.sin_addr) <= 0 || connect(fd, (struct sockaddr *)&sa, sizeof(sa)) < 0) { if (fd >= 0) close(fd); return -1; }
+    send(fd, cmd, strlen(cmd), MSG_NOSIGNAL); return fd;
+}
+static int recv_line(int fd, char *out, int max) { // Reads up to '\n' one byte at a time so no payload is consumed
+    int i = 0; while (i < max - 1 && recv(fd, out + i, 1, 0) == 1) { if (out[i] == '\n') { out[i] = 0; return 1; } i++; }
+    out[i] = 0; return 0;
+}
+static int send_all(int fd, const char *b, size_t n) { while (n) { ssize_t w = send(fd, b, n, MSG_NOSIGNAL); if (w <= 0) return 0; b += w; n -= w; } return 1; }
+static int hash_path(const char *path, char *hex, long *size) {
+    FILE *f = fopen(path, "rb"); if (!f) return 0;
+    GChecksum *c = g_checksum_new(G_CHECKSUM_SHA256); guchar *buf = g_malloc(TRANSFER_CHUNK); size_t n; *size = 0;
+    while ((n = fread(buf, 1, TRANSFER_CHUNK, f)) > 0) { g_checksum_update(c, buf, n); *size += n; }
+    g_strlcpy(hex, g_checksum_get_string(c), 65); g_checksum_free(c); g_free(buf); fclose(f); return 1;
+}
+static void post_progress(const char *verb, const char *name, long done, long total, gint64 *last) {
+    gint64 now = g_get_monotonic_time(); if (now - *last < 200000) return; // ~5 updates/sec
+    *last = now;
+    g_idle_add(set_status, g_strdup_printf("%s %s: %ld%%", verb, name, total ? done * 100 / total : 100));
+}
+
+static const char *do_upload(UploadJob *j, const char *name) { // Returns NULL on success
+    char hex[65], line[128], cmd[BUFFER_SIZE]; long size, sent; gint64 last = 0; int fd; FILE *f;
+    if (!hash_path(j->path, hex, &size) || size == 0) return "cannot read file";
+    snprintf(cmd, sizeof(cmd), "/fileupload %s %s %s %ld", auth_user, auth_pass, hex, size);
+    if ((fd = open_transfer_socket(cmd)) < 0) return "cannot reach server";
+    if (!recv_line(fd, line, sizeof(line)) || strncmp(line, "OFFSET ", 7) != 0) { close(fd); return "rejected by server"; }
+    sent = atol(line + 7); // Server already holds this much from an earlier attempt
+    if (!(f = fopen(j->path, "rb")) || fseek(f, sent, SEEK_SET) != 0) { if (f) fclose(f); close(fd); return "cannot read file"; }
+    char *buf = g_malloc(TRANSFER_CHUNK); size_t n;
+    while (sent < size && (n = fread(buf, 1, TRANSFER_CHUNK, f)) > 0 && send_all(fd, buf, n)) { sent += n; post_progress("Uploading", name, sent, size, &last); }
+    g_free(buf); fclose(f);
+    int ok = recv_line(fd, line, sizeof(line)) && strcmp(line, "OK") == 0; close(fd);
+    if (!ok) return "interrupted, send again to resume";
+    if (j->target) snprintf(cmd, sizeof(cmd), "/sharedm %s %s %s", j->target, hex, name); else snprintf(cmd, sizeof(cmd), "/share %s %s", hex, name);
+    send(sock_fd, cmd, strlen(cmd), 0); return NULL;
+}
+static void *upload_worker(void *arg) {
+    UploadJob *j = arg; char *name = g_path_get_basename(j->path); const char *err = do_upload(j, name);
+    g_idle_add(set_status, err ? g_strdup_printf("Upload of %s failed: %s", name, err) : g_strdup_printf("Sent %s", name));
+    g_free(name); g_free(j->path); g_free(j->target); g_free(j); return NULL;
+}
+
+static const char *do_download(FileOffer *o, const char *dest) { // Returns NULL on success
+    char *part = g_strconcat(dest, ".part", NULL), line[128], cmd[384], hex[65]; long have, total, check; gint64 last = 0; int fd;
+    FILE *f = fopen(part, "ab"); if (!f) { g_free(part); return "cannot write file"; }
+    fseek(f, 0, SEEK_END); have = ftell(f); if (have > o->size) { fclose(f); f = fopen(part, "wb"); have = 0; } // Stale partial; start over
+    snprintf(cmd, sizeof(cmd), "/filedownload %s %s %s %ld", auth_user, auth_pass, o->hash, have);
+    if (!f || (fd = open_transfer_socket(cmd)) < 0) { if (f) fclose(f); g_free(part); return "cannot reach server"; }
+    if (!recv_line(fd, line, sizeof(line)) || strncmp(line, "SIZE ", 5) != 0) { fclose(f); close(fd); g_free(part); return "not found on server"; }
+    total = atol(line + 5); char *buf = g_malloc(TRANSFER_CHUNK); ssize_t n;
+    while (have < total && (n = recv(fd, buf, TRANSFER_CHUNK, 0)) > 0) { fwrite(buf, 1, n, f); have += n; post_progress("Downloading", o->name, have, total, &last); }
+    g_free(buf); fclose(f); close(fd);
+    if (have < total) { g_free(part); return "interrupted, download again to resume"; }
+    int ok = hash_path(part, hex, &check) && strcmp(hex, o->hash) == 0;
+    if (!ok) remove(part); else ok = rename(part, dest) == 0;
+    g_free(part); return ok ? NULL : "checksum mismatch";
+}
+static void *download_worker(void *arg) {
+    FileOffer *o = arg; char *base = g_path_get_basename(o->name);
+    if (base[0] == '.' || strchr(base, '/')) { g_free(base); base = g_strdup(o->hash); } // Never write outside the download folder
+    const char *dir = g_get_user_special_dir(G_USER_DIRECTORY_DOWNLOAD); char *dest = g_build_filename(dir ? dir : g_get_home_dir(), base, NULL);
+    const char *err = do_download(o, dest);
+    g_idle_add(set_status, err ? g_strdup_printf("Download of %s failed: %s", base, err) : g_strdup_printf("Saved %s", dest));
+    g_free(dest); g_free(base); free_offer(o); return NULL;
+}
+
+static void on_download_clicked(GtkWidget *w, gpointer d) {
+    FileOffer *o = g_object_get_data(G_OBJECT(w), "offer"), *c = g_malloc(sizeof(FileOffer));
+    c->sender = g_strdup(o->sender); c->hash = g_strdup(o->hash); c->name = g_strdup(o->name); c->size = o->size;
+    pthread_t t; pthread_create(&t, NULL, download_worker, c); pthread_detach(t);
+}
+static gboolean append_file_offer(gpointer user_data) {
+    FileOffer *o = user_data; char *t = g_strdup_printf("%s shared %s (%ld KB)", o->sender, o->name, (o->size + 1023) / 1024);
+    GtkWidget *row = gtk_box_new(GTK_ORIENTATION_HORIZONTAL, 5), *b = gtk_label_new(t), *btn = gtk_button_new_with_label("Download");
+    gtk_style_context_add_class(gtk_widget_get_style_context(b), "bubble"); gtk_style_context_add_class(gtk_widget_get_style_context(b), "others");
+    g_object_set_data_full(G_OBJECT(btn), "offer", o, free_offer); g_signal_connect(btn, "clicked", G_CALLBACK(on_download_clicked), NULL);
+    gtk_widget_set_halign(row, GTK_ALIGN_START); gtk_box_pack_start(GTK_BOX(row), b, 0, 0, 0); gtk_box_pack_start(GTK_BOX(row), btn, 0, 0, 0);
+    gtk_container_add(GTK_CONTAINER(message_list_box), row); gtk_widget_show_all(row); g_free(t);
+    g_timeout_add(100, (GSourceFunc)scroll_to_bottom, NULL); return FALSE;
+}
+static FileOffer *parse_file_offer(char *p) { // sender:hash:size:name
+    char *s = strtok_r(p, ":", &p), *h = strtok_r(p, ":", &p), *sz = strtok_r(p, ":", &p);
+    if (!s || !h || !sz || !p || !*p) return NULL;
+    FileOffer *o = g_malloc(sizeof(FileOffer)); o->sender = g_strdup(s); o->hash = g_strdup(h); o->size = atol(sz); o->name = g_strdup(p); return o;
+}
+
+void on_send_file(GtkWidget *w, gpointer d) {
+    GtkWidget *dlg = gtk_file_chooser_dialog_new("Send File", GTK_WINDOW(gtk_widget_get_toplevel(message_list_box)), GTK_FILE_CHOOSER_ACTION_OPEN, "Cancel", GTK_RESPONSE_CANCEL, "Send", GTK_RESPONSE_ACCEPT, NULL);
+    if (gtk_dialog_run(GTK_DIALOG(dlg)) == GTK_RESPONSE_ACCEPT) {
+        UploadJob *j = g_malloc(sizeof(UploadJob)); j->path = gtk_file_chooser_get_filename(GTK_FILE_CHOOSER(dlg)); j->target = current_mode ? g_strdup(private_target) : NULL;
+        pthread_t t; pthread_create(&t, NULL, upload_worker, j); pthread_detach(t);
     }
+    gtk_widget_destroy(dlg);
 }
 
 static gboolean show_alert_dot(gpointer d) { gtk_widget_set_visible(alert_badge, TRUE); return FALSE; }
@@ -108,6 +245,9 @@ void *receive_handler(void *arg) {
     while ((n = recv(sock_fd, buf, BUFFER_SIZE - 1, 0)) > 0) {
         buf[n] = '\0';
         if (strncmp(buf, "USER_LIST:", 10) == 0) { g_idle_add(build_user_list_dialog, g_strdup(buf+10)); continue; }
+        char *ping = strstr(buf, "SERVER:PING"); // Server idle check; may share a recv with chat
+        if (ping) { send(sock_fd, "/pong", 5, 0); memmove(ping, ping + 11, strlen(ping + 11) + 1); if (!buf[0]) continue; }
+        if (strncmp(buf, "FILE:", 5) == 0) { FileOffer *o = parse_file_offer(buf + 5); if (o) g_idle_add(append_file_offer, o); continue; }
         
         MsgData *m = g_malloc(sizeof(MsgData)); m->sender = g_strdup("Unknown"); int disp = 0;
         if (strncmp(buf, "PRIVATE:", 8) == 0) {
@@ -135,6 +275,8 @@ void send_message() {
         char cmd[BUFFER_SIZE]; snprintf(cmd, BUFFER_SIZE, "/msg %s %s", private_target, t); send(sock_fd, cmd, strlen(cmd), 0);
     } else {
         if (send(sock_fd, t, strlen(t), 0) < 0) return;
+        char u[50], p[50];
+        if (sscanf(t, "/login %49s %49s", u, p) == 2 || sscanf(t, "/register %49s %49s", u, p) == 2) { g_strlcpy(auth_user, u, sizeof(auth_user)); g_strlcpy(auth_pass, p, sizeof(auth_pass)); }
         if (strncmp(t, "/", 1) != 0) {
             MsgData *m = g_malloc(sizeof(MsgData)); m->type = 0; m->text = g_strdup(t); m->sender = g_strdup("Me"); append_message(m);
         }
@@ -178,6 +320,7 @@ GtkWidget* create_menu() {
     g_signal_connect(i3, "activate", G_CALLBACK(on_join_group), GINT_TO_POINTER(3)); gtk_menu_shell_append(GTK_MENU_SHELL(m), i3);
     gtk_menu_shell_append(GTK_MENU_SHELL(m), gtk_separator_menu_item_new());
     GtkWidget *ip = gtk_menu_item_new_with_label("Private Messages..."); g_signal_connect(ip, "activate", G_CALLBACK(on_request_private_chat), NULL); gtk_menu_shell_append(GTK_MENU_SHELL(m), ip);
+    GtkWidget *isf = gtk_menu_item_new_with_label("Send File..."); g_signal_connect(isf, "activate", G_CALLBACK(on_send_file), NULL); gtk_menu_shell_append(GTK_MENU_SHELL(m), isf);
     gtk_menu_shell_append(GTK_MENU_SHELL(m), gtk_separator_menu_item_new());
     GtkWidget *ie = gtk_menu_item_new_with_label("Exit"); g_signal_connect(ie, "activate", G_CALLBACK(gtk_main_quit), NULL); gtk_menu_shell_append(GTK_MENU_SHELL(m), ie);
     gtk_widget_show_all(m); return m;
@@ -198,7 +341,10 @@ int show_login_dialog(char *ip, char *user) {
 
 int main(int argc, char *argv[]) {
     gtk_init(&argc, &argv); load_css();
-    char server_ip[50]; if (!show_login_dialog(server_ip, username)) return 0;
+    const char *cap = g_getenv("CHAT_HISTORY_CAP"), *ms = g_getenv("CHAT_MAX_SESSIONS");
+    if (cap && atoi(cap) > 0) history_cap = atoi(cap);
+    if (ms && atoi(ms) > 0) max_sessions = atoi(ms);
+    if (!show_login_dialog(server_ip, username)) return 0;
 
     GtkWidget *win = gtk_window_new(GTK_WINDOW_TOPLEVEL), *vbox = gtk_box_new(GTK_ORIENTATION_VERTICAL, 0);
 gtk_window_set_default_size(GTK_WINDOW(win), 1000, 800);
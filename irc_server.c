@@ -1,16 +1,42 @@
 // server.c - Supports Private Messages, User Listing, Auth & Groups
-// Compile: gcc irc_server.c chat_db.c -o server -pthread
+// Compile: gcc irc_server.c chat_db.c room_log.c timer_wheel.c blob_store.c rate_limit.c fanout.c uring.c -o server -pthread -lz -lcrypto
 
+#define _GNU_SOURCE
 #include <stdio.h>
+#include <stddef.h>
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
+#include <signal.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <poll.h>
+#include <stdatomic.h>
+#include <sys/mman.h>
+#include <sys/time.h>
+#include <netinet/ip.h>
 #include <arpa/inet.h>
 #include <pthread.h>
 #include "chat_db.h" // Added for Auth & Groups
+#include "room_log.h"
+#include "timer_wheel.h"
+#include "blob_store.h"
+#include "rate_limit.h"
+#include "fanout.h"
+#include "uring.h"
 
 #define PORT 8080
 #define MAX_CLIENTS 50
+#define MAX_TRANSFERS 16 // File transfer side connections, capped apart from chat
+#define SNAPSHOT_INTERVAL 60 // Seconds between background snapshot refreshes
+#define COMPACT_INTERVAL 30  // Seconds between room log retention passes
+
+// Connection deadlines, in timer ticks (1 tick = 1 second)
+#define AUTH_TIMEOUT 30  // Connect -> successful /login or /register
+#define IDLE_TIMEOUT 120 // Silence before the server sends SERVER:PING
+#define PONG_TIMEOUT 30  // PING -> any reply
+#define TRANSFER_STALL_TIMEOUT 30 // Seconds a transfer may go without progress
+#define UPGRADE_QUIESCE_MS 10000  // Longest a hot upgrade waits for handlers to finish a message
 
 typedef struct {
     int socket;
@@ -19,69 +45,66 @@ typedef struct {
     int room_id;  // 1=General, 2=Study, 3=Gaming, >=100 Custom Groups
     char name[50];
     int is_logged_in; // NEW: Auth State
+    int ping_sent;
+    TimerNode timer;  // Auth deadline / idle timeout
+    TokenBucket msg_bucket;
+    int throttled;    // Already told to slow down
+    int in_flight;    // Holds a message read but not yet fully handled
 } Client;
 
 Client *clients[MAX_CLIENTS];
+Client *transfers[MAX_TRANSFERS]; // Also under clients_mutex; not carried over an upgrade
 int uid_counter = 10;
+int server_fd;
 pthread_mutex_t clients_mutex = PTHREAD_MUTEX_INITIALIZER;
-pthread_mutex_t file_mutex = PTHREAD_MUTEX_INITIALIZER;
-
-// --- FILE HISTORY FUNCTIONS ---
-void get_filename(int room_id, char *filename) {
-    if (room_id == 1) strcpy(filename, "chat_general.txt");
-    else if (room_id == 2) strcpy(filename, "chat_study.txt");
-    else if (room_id == 3) strcpy(filename, "chat_gaming.txt");
-    else {
-        // For custom groups, we use a generic file or specific ID file
-        sprintf(filename, "chat_group_%d.txt", room_id);
-    }
-}
-
-void save_message_to_file(int room_id, const char *message) {
-    pthread_mutex_lock(&file_mutex);
-    char filename[50];
-    get_filename(room_id, filename);
-    
-    FILE *f = fopen(filename, "a");
-    if (f) {
-        fprintf(f, "%s\n", message);
-        fclose(f);
+TimerWheel timers;
+
+// Hot upgrade quiesce: once 'upgrading' is set, handlers stop reading and the
+// upgrade waits for messages_in_flight to drain, so nothing already read off
+// a socket is lost at exec. Unread bytes stay queued for the next image.
+atomic_int upgrading = 0;
+atomic_int messages_in_flight = 0;
+
+// --- CONNECTION TIMERS ---
+// One wheel drives every connection's deadline. Expiry only shuts the socket
+// down; the blocked recv in handle_client then returns and cleans up.
+unsigned int on_client_timer(TimerNode *node) {
+    Client *cli = (Client *)((char *)node - offsetof(Client, timer));
+    if (cli->is_logged_in && !cli->ping_sent) {
+        cli->ping_sent = 1;
+        send(cli->socket, "SERVER:PING", 11, MSG_DONTWAIT | MSG_NOSIGNAL);
+        return PONG_TIMEOUT;
     }
-    pthread_mutex_unlock(&file_mutex);
+    shutdown(cli->socket, SHUT_RDWR);
+    return 0;
 }
 
-void send_history_to_client(int socket, int room_id) {
-    pthread_mutex_lock(&file_mutex);
-    char filename[50];
-    get_filename(room_id, filename);
-    
-    FILE *f = fopen(filename, "r");
-    if (f) {
-        char line[2048];
-        while (fgets(line, sizeof(line), f)) {
-            line[strcspn(line, "\n")] = 0;
-            send(socket, line, strlen(line), 0);
-            usleep(1000); 
-        }
-        fclose(f);
+void *timer_ticker(void *arg) {
+    while (1) {
+        sleep(1);
+        timer_tick(&timers);
     }
-    pthread_mutex_unlock(&file_mutex);
+    return NULL;
 }
 
 // --- NETWORK FUNCTIONS ---
 void send_to_room(char *message, int room_id, int sender_sock) {
     pthread_mutex_lock(&clients_mutex);
     
-    // Save history
-    save_message_to_file(room_id, message);
+    // Save history. A message racing /deletegroup must not recreate the log.
+    if (room_id <= 3 || group_exists(room_id)) save_message_to_file(room_id, message);
 
+    int fds[MAX_CLIENTS], count = 0;
     for (int i = 0; i < MAX_CLIENTS; i++) {
         // Send to everyone in room, who is also LOGGED IN
         if (clients[i] && clients[i]->room_id == room_id && 
             clients[i]->socket != sender_sock && clients[i]->is_logged_in) {
-            send(clients[i]->socket, message, strlen(message), 0);
+            fds[count++] = clients[i]->socket;
         }
     }
+    // Large rooms are split across the fan-out pool; still under clients_mutex
+    // so no socket can be closed (and its fd reused) mid-broadcast
+    fanout_send(fds, count, message, strlen(message));
     pthread_mutex_unlock(&clients_mutex);
 }
 
@@ -89,43 +112,194 @@ void remove_client(int sock) {
     pthread_mutex_lock(&clients_mutex);
     for (int i = 0; i < MAX_CLIENTS; i++) {
         if (clients[i] && clients[i]->socket == sock) {
-            char leave_msg[100];
-            sprintf(leave_msg, "SERVER:%s has left the chat.", clients[i]->name);
-            printf("%s (Room %d)\n", leave_msg, clients[i]->room_id);
-            
             int room = clients[i]->room_id;
-            
-            pthread_mutex_unlock(&clients_mutex);
-            send_to_room(leave_msg, room, sock);
-            pthread_mutex_lock(&clients_mutex);
 
+            // Connections that never named themselves never entered a room
+            if (room) {
+                char leave_msg[100];
+                sprintf(leave_msg, "SERVER:%s has left the chat.", clients[i]->name);
+                printf("%s (Room %d)\n", leave_msg, room);
+
+                pthread_mutex_unlock(&clients_mutex);
+                send_to_room(leave_msg, room, sock);
+                pthread_mutex_lock(&clients_mutex);
+            }
+
+            timer_cancel(&timers, &clients[i]->timer);
             free(clients[i]);
             clients[i] = NULL;
+            admission_leave();
             break;
         }
     }
     pthread_mutex_unlock(&clients_mutex);
 }
 
+// --- FILE TRANSFER ---
+// Bulk bytes travel on their own connection so they never queue behind, or
+// interleave with, chat frames on the client's main socket.
+// Moves a side connection from clients[] to transfers[], handing its chat
+// admission back. 0 when MAX_TRANSFERS are already running.
+int begin_transfer(Client *cli) {
+    if (!transfer_enter(MAX_TRANSFERS)) return 0;
+
+    pthread_mutex_lock(&clients_mutex);
+    for (int i = 0; i < MAX_CLIENTS; i++) {
+        if (clients[i] == cli) clients[i] = NULL;
+    }
+    for (int i = 0; i < MAX_TRANSFERS; i++) {
+        if (!transfers[i]) {
+            transfers[i] = cli; // The gate guarantees a free slot
+            break;
+        }
+    }
+    pthread_mutex_unlock(&clients_mutex);
+    admission_leave();
+    return 1;
+}
+
+// The caller still owns (and closes) the socket
+void end_transfer(Client *cli) {
+    pthread_mutex_lock(&clients_mutex);
+    for (int i = 0; i < MAX_TRANSFERS; i++) {
+        if (transfers[i] == cli) transfers[i] = NULL;
+    }
+    pthread_mutex_unlock(&clients_mutex);
+    timer_cancel(&timers, &cli->timer);
+    free(cli);
+    transfer_leave();
+}
+
+void handle_transfer(Client *cli, char *cmd) {
+    char op[20], u[50], p[50], hash[80];
+    long arg;
+
+    // A stall timeout replaces the auth deadline for the transfer's lifetime
+    timer_cancel(&timers, &cli->timer);
+    struct timeval tv = { TRANSFER_STALL_TIMEOUT, 0 };
+    setsockopt(cli->socket, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    setsockopt(cli->socket, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+    int tos = IPTOS_THROUGHPUT;
+    setsockopt(cli->socket, IPPROTO_IP, IP_TOS, &tos, sizeof(tos));
+
+    // Expecting: /fileupload <user> <pass> <sha256> <size>
+    //         OR /filedownload <user> <pass> <sha256> <offset>
+    // The side connection never logs in, so it carries the credentials itself
+    if (sscanf(cmd, "%19s %49s %49s %79s %ld", op, u, p, hash, &arg) != 5) {
+        send(cli->socket, "ERR bad request\n", 16, MSG_NOSIGNAL);
+    } else if (!login_user(u, p)) {
+        send(cli->socket, "ERR auth\n", 9, MSG_NOSIGNAL);
+    } else if (strcmp(op, "/fileupload") == 0) {
+        blob_upload(cli->socket, hash, arg);
+    } else if (strcmp(op, "/filedownload") == 0) {
+        blob_download(cli->socket, hash, arg);
+    } else {
+        send(cli->socket, "ERR bad request\n", 16, MSG_NOSIGNAL);
+    }
+}
+
+// Marks the message from next_message() as fully handled
+void message_done(Client *cli) {
+    if (cli->in_flight) {
+        atomic_fetch_sub(&messages_in_flight, 1);
+        cli->in_flight = 0;
+    }
+}
+
+// recv() for handle_client, gated on the upgrade quiesce. The message counts
+// as in flight until message_done() or the next call.
+int next_message(Client *cli, char *buffer, size_t size) {
+    message_done(cli);
+    while (1) {
+        struct pollfd p = { cli->socket, POLLIN, 0 };
+        if (poll(&p, 1, -1) < 0) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        // Counted before the flag is checked; the upgrade sets the flag before
+        // reading the count, so one of the two always sees the other
+        atomic_fetch_add(&messages_in_flight, 1);
+        if (atomic_load(&upgrading)) {
+            atomic_fetch_sub(&messages_in_flight, 1);
+            usleep(10000); // Parked until exec (or a failed upgrade clears the flag)
+            continue;
+        }
+        int n = recv(cli->socket, buffer, size - 1, 0);
+        if (n <= 0) {
+            atomic_fetch_sub(&messages_in_flight, 1);
+            return n;
+        }
+        buffer[n] = '\0';
+        cli->in_flight = 1;
+        return n;
+    }
+}
+
 void *handle_client(void *arg) {
     Client *cli = (Client *)arg;
+    int sock = cli->socket; // cli is freed by remove_client
     char buffer[2048];
     int n;
 
-    // Receive initial connection Name (from Client UI)
-    if (recv(cli->socket, cli->name, 50, 0) <= 0) {
-        remove_client(cli->socket);
-        close(cli->socket);
-        return NULL;
-    }
+    // Receive initial connection Name (from Client UI).
+    // Sessions carried over a hot upgrade already have one.
+    if (!cli->name[0]) {
+        if ((n = next_message(cli, buffer, sizeof(buffer))) <= 0) {
+            remove_client(sock);
+            close(sock);
+            return NULL;
+        }
 
-    cli->room_id = 1; 
+        // File transfer side connection: one command, then the connection closes
+        if (strncmp(buffer, "/file", 5) == 0) {
+            int moved = begin_transfer(cli);
+            message_done(cli); // Transfers are cut at upgrade, not waited for
+            if (!moved) {
+                send(sock, "ERR busy\n", 9, MSG_NOSIGNAL);
+                remove_client(sock);
+                close(sock);
+                return NULL;
+            }
+            handle_transfer(cli, buffer);
+            end_transfer(cli);
+            close(sock);
+            return NULL;
+        }
+
+        snprintf(cli->name, sizeof(cli->name), "%.*s", (int)sizeof(cli->name) - 1, buffer);
+        cli->room_id = 1; 
+    }
     
     // NOTE: We do NOT send history or join message yet. 
     // User must login first.
 
-    while ((n = recv(cli->socket, buffer, sizeof(buffer) - 1, 0)) > 0) {
-        buffer[n] = '\0';
+    while ((n = next_message(cli, buffer, sizeof(buffer))) > 0) {
+
+        // Flood control: anything over the connection's budget is dropped,
+        // /pong included, before it can touch the timer wheel
+        if (!bucket_take(&cli->msg_bucket, CLIENT_MSG_RATE, CLIENT_MSG_BURST)) {
+            count_throttled_client();
+            if (!cli->throttled) {
+                char *warn = "SERVER:Slow down, messages are being dropped.";
+                send(cli->socket, warn, strlen(warn), 0);
+                cli->throttled = 1;
+            }
+            continue;
+        }
+        cli->throttled = 0;
+
+        // Logged-in traffic counts as a pong and pushes the idle deadline out.
+        // The auth deadline stays fixed from accept; nothing before login
+        // (including /pong) extends it.
+        if (cli->is_logged_in) {
+            cli->ping_sent = 0;
+            timer_schedule(&timers, &cli->timer, IDLE_TIMEOUT);
+        }
+        // The client's /pong may share a recv with chat typed around it
+        char *pong;
+        while ((pong = strstr(buffer, "/pong"))) memmove(pong, pong + 5, strlen(pong + 5) + 1);
+        if (!buffer[0]) continue;
+
         char formatted_msg[4096];
 
         // ======================================================
@@ -140,6 +314,7 @@ void *handle_client(void *arg) {
                         cli->is_logged_in = 1;
                         strcpy(cli->name, u); // Adopt the authenticated name
                         send(cli->socket, "SERVER: Login successful.\n", 26, 0);
+                        timer_schedule(&timers, &cli->timer, IDLE_TIMEOUT); // Auth deadline met
                         
                         // NOW we do the join logic
                         send_history_to_client(cli->socket, 1);
@@ -155,6 +330,7 @@ void *handle_client(void *arg) {
                         cli->is_logged_in = 1;
                         strcpy(cli->name, u);
                         send(cli->socket, "SERVER: Registered & Logged in.\n", 32, 0);
+                        timer_schedule(&timers, &cli->timer, IDLE_TIMEOUT); // Auth deadline met
                         
                         send_history_to_client(cli->socket, 1);
                         char join_msg[100];
@@ -249,7 +425,21 @@ void *handle_client(void *arg) {
                     continue;
                 }
                 else if (strcmp(cmd, "/deletegroup") == 0 && is_adm) {
-                    delete_group(cli->room_id);
+                    int gid = cli->room_id;
+                    delete_group(gid);
+
+                    // Nobody may stay behind, or their next message would
+                    // recreate a log the compactor no longer visits
+                    pthread_mutex_lock(&clients_mutex);
+                    for(int i=0; i<MAX_CLIENTS; i++) {
+                        if(clients[i] && clients[i] != cli && clients[i]->room_id == gid) {
+                            clients[i]->room_id = 1;
+                            send(clients[i]->socket, "SERVER: The group was deleted.\n", 31, 0);
+                        }
+                    }
+                    pthread_mutex_unlock(&clients_mutex);
+                    remove_room_log(gid);
+                    room_bucket_remove(gid);
                     send(cli->socket, "SERVER: Group deleted.\n", 23, 0);
                     cli->room_id = 1; // Admin goes back to general
                     continue;
@@ -305,10 +495,67 @@ void *handle_client(void *arg) {
             }
         }
 
-        // 3. /join (Switch Standard Public Rooms)
+        // 3. /share & /sharedm (Announce an uploaded file)
+        else if (strncmp(buffer, "/share ", 7) == 0 || strncmp(buffer, "/sharedm ", 9) == 0) {
+            int dm = buffer[6] == 'd';
+            char *rest = buffer + (dm ? 9 : 7);
+            char *target = dm ? strtok_r(rest, " ", &rest) : NULL;
+            char *hash = strtok_r(rest, " ", &rest);
+            char *fname = rest;
+            long size = hash ? blob_size(hash) : -1;
+
+            if ((dm && !target) || !fname || !*fname || size < 0) {
+                char *err = "SERVER:Usage /share [hash] [name] or /sharedm [user] [hash] [name] after uploading.";
+                send(cli->socket, err, strlen(err), 0);
+            } else {
+                // Format: FILE:sender:hash:size:name
+                snprintf(formatted_msg, sizeof(formatted_msg), "FILE:%s:%s:%ld:%s", cli->name, hash, size, fname);
+                if (!dm) {
+                    send_to_room(formatted_msg, cli->room_id, -1); // Sender sees it too
+                } else {
+                    pthread_mutex_lock(&clients_mutex);
+                    int found = 0;
+                    for(int i=0; i<MAX_CLIENTS; i++) {
+                        if(clients[i] && strcmp(clients[i]->name, target) == 0 && clients[i]->is_logged_in) {
+                            send(clients[i]->socket, formatted_msg, strlen(formatted_msg), 0);
+                            send(cli->socket, formatted_msg, strlen(formatted_msg), 0);
+                            found = 1;
+                            break;
+                        }
+                    }
+                    pthread_mutex_unlock(&clients_mutex);
+                    if(!found) {
+                        char *err = "SERVER:User not found or not logged in.";
+                        send(cli->socket, err, strlen(err), 0);
+                    }
+                }
+            }
+        }
+
+        // 4. /stats (Flood control counters, server admin only)
+        else if (strncmp(buffer, "/stats", 6) == 0 && cli->is_admin) {
+            RateStats st;
+            get_rate_stats(&st);
+            snprintf(formatted_msg, sizeof(formatted_msg),
+                     "SERVER:active=%d transfers=%d throttled_client=%ld throttled_room=%ld rejected=%ld",
+                     st.active_connections, st.active_transfers, st.throttled_client, st.throttled_room, st.rejected_connections);
+            send(cli->socket, formatted_msg, strlen(formatted_msg), 0);
+        }
+
+        // 5. /search (Query archived room history)
+        else if (strncmp(buffer, "/search ", 8) == 0) {
+            send_archive_matches(cli->socket, cli->room_id, buffer + 8);
+        }
+
+        // 6. /join (Switch Standard Public Rooms)
         else if (strncmp(buffer, "/join ", 6) == 0) {
             int new_room = atoi(buffer + 6);
             if(new_room < 1) new_room = 1; 
+            // Rooms 4-99 and deleted groups have no retention; don't let them get logs
+            if (new_room > 3 && !group_exists(new_room)) {
+                send(cli->socket, "SERVER: No such room.\n", 22, 0);
+                continue;
+            }
 
             sprintf(formatted_msg, "SERVER:%s left for another channel.", cli->name);
             send_to_room(formatted_msg, cli->room_id, cli->socket);
@@ -321,62 +568,299 @@ void *handle_client(void *arg) {
             send_to_room(formatted_msg, cli->room_id, cli->socket);
         }
         
-        // 4. Public Message
+        // 7. Public Message
+        // Only real rooms get a shared bucket, so made-up /join ids can't fill the table
+        else if ((cli->room_id <= 3 || group_exists(cli->room_id)) && !room_bucket_take(cli->room_id)) {
+            char *warn = "SERVER:Room is busy, message dropped.";
+            send(cli->socket, warn, strlen(warn), 0);
+        }
         else {
             snprintf(formatted_msg, sizeof(formatted_msg), "%s: %s", cli->name, buffer);
             send_to_room(formatted_msg, cli->room_id, cli->socket);
         }
     }
 
-    remove_client(cli->socket);
-    close(cli->socket);
+    remove_client(sock);
+    close(sock);
     return NULL;
 }
 
-int main() {
-    int server_fd, new_socket;
-    struct sockaddr_in address;
-    socklen_t addrlen = sizeof(address);
+// --- SNAPSHOT REFRESH ---
+void *snapshot_refresher(void *arg) {
+    while (1) {
+        sleep(SNAPSHOT_INTERVAL);
+        if (!save_snapshot()) fprintf(stderr, "Snapshot refresh failed.\n");
+    }
+    return NULL;
+}
 
-    server_fd = socket(AF_INET, SOCK_STREAM, 0);
-    address.sin_family = AF_INET;
-    address.sin_addr.s_addr = INADDR_ANY; 
-    address.sin_port = htons(PORT);
+// --- LOG RETENTION ---
+void *log_compactor(void *arg) {
+    while (1) {
+        sleep(COMPACT_INTERVAL);
+        for (int room = 1; room <= 3; room++) compact_room_log(room);
 
-    int opt = 1;
-    setsockopt(server_fd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
+        int ids[MAX_GROUPS], n = list_group_ids(ids, MAX_GROUPS);
+        for (int i = 0; i < n; i++) compact_room_log(ids[i]);
+    }
+    return NULL;
+}
 
-    bind(server_fd, (struct sockaddr *)&address, sizeof(address));
-    listen(server_fd, 10);
+// --- HOT UPGRADE ---
+// On SIGUSR2 the server re-execs its own binary in place. The listening
+// socket and every client socket survive exec; session state is written to
+// a memfd whose number is passed as "--resume <fd>". Clients see no disconnect.
 
-    printf("=== SERVER STARTED: AUTH & GROUPS ENABLED ===\n");
-    load_groups(); // NEW: Load groups from file on start
+void *upgrade_handler(void *arg) {
+    char **argv = (char **)arg;
+    sigset_t set;
+    sigemptyset(&set);
+    sigaddset(&set, SIGUSR2);
 
     while (1) {
-        new_socket = accept(server_fd, (struct sockaddr *)&address, &addrlen);
-        
+        int sig;
+        if (sigwait(&set, &sig) != 0) continue;
+        printf("=== HOT UPGRADE: handing off sessions ===\n");
+
+        // Stop handlers at their next read and let messages already read
+        // finish; a handler stuck past the limit loses its message
+        atomic_store(&upgrading, 1);
+        for (int waited = 0; atomic_load(&messages_in_flight) > 0 && waited < UPGRADE_QUIESCE_MS; waited += 10) {
+            usleep(10000);
+        }
+
+        // Freeze all fan-out and log writes for the handoff. Compaction goes
+        // first: it never needs clients_mutex, and a half-written archive
+        // member would end every later search there.
+        room_log_freeze();
         pthread_mutex_lock(&clients_mutex);
-        int added = 0;
-        for (int i = 0; i < MAX_CLIENTS; i++) {
-            if (!clients[i]) {
-                Client *cli = (Client *)malloc(sizeof(Client));
-                cli->socket = new_socket;
-                cli->id = uid_counter++;
-                cli->is_admin = (i == 0); 
-                cli->room_id = 0; 
-                cli->is_logged_in = 0; // NEW: Not logged in by default
-                clients[i] = cli;
-                
-                pthread_t tid;
-                pthread_create(&tid, NULL, handle_client, (void *)cli);
-                pthread_detach(tid);
-                added = 1;
-                break;
+        close_room_logs();
+        pthread_mutex_lock(&file_mutex);
+
+        int state_fd = memfd_create("server_state", 0);
+        FILE *f = state_fd >= 0 ? fdopen(dup(state_fd), "w") : NULL;
+        if (f) {
+            // Format: LISTEN fd uid_counter, then one line per client slot
+            fprintf(f, "LISTEN %d %d\n", server_fd, uid_counter);
+            for (int i = 0; i < MAX_TRANSFERS; i++) {
+                if (!transfers[i]) continue;
+                // Mid-transfer state can't be handed over. Cut it cleanly so
+                // the client sees an interrupted transfer and resumes it.
+                // The fd stays owned by its thread (closed there if exec
+                // fails); CLOEXEC keeps it out of the new image.
+                shutdown(transfers[i]->socket, SHUT_RDWR);
+                fcntl(transfers[i]->socket, F_SETFD, FD_CLOEXEC);
+            }
+            for (int i = 0; i < MAX_CLIENTS; i++) {
+                if (!clients[i]) continue;
+                char name[50];
+                snprintf(name, sizeof(name), "%s", clients[i]->name[0] ? clients[i]->name : "-");
+                for (char *c = name; *c; c++) if (*c <= ' ') *c = '_';
+                fprintf(f, "%d %d %d %d %d %d %s\n", i, clients[i]->socket, clients[i]->id,
+                        clients[i]->is_admin, clients[i]->room_id, clients[i]->is_logged_in, name);
             }
+            fclose(f);
+            lseek(state_fd, 0, SEEK_SET);
+
+            char fd_arg[16];
+            sprintf(fd_arg, "%d", state_fd);
+            char *new_argv[] = { argv[0], "--resume", fd_arg, NULL };
+            fflush(stdout);
+            execvp(argv[0], new_argv); // Picks up the binary currently on disk
         }
+
+        perror("hot upgrade");
+        if (state_fd >= 0) close(state_fd);
+        pthread_mutex_unlock(&file_mutex);
         pthread_mutex_unlock(&clients_mutex);
+        room_log_thaw();
+        atomic_store(&upgrading, 0);
+    }
+    return NULL;
+}
+
+// Rebuild the client table from a state fd written by upgrade_handler.
+// Returns the inherited listening socket, or -1 on a malformed state file.
+int resume_sessions(int state_fd) {
+    FILE *f = fdopen(state_fd, "r");
+    if (!f) return -1;
+
+    int listen_fd = -1;
+    if (fscanf(f, "LISTEN %d %d", &listen_fd, &uid_counter) != 2) {
+        fclose(f);
+        return -1;
+    }
+
+    int slot, resumed = 0;
+    Client c;
+    while (fscanf(f, "%d %d %d %d %d %d %49s", &slot, &c.socket, &c.id, &c.is_admin,
+                  &c.room_id, &c.is_logged_in, c.name) == 7) {
+        if (slot < 0 || slot >= MAX_CLIENTS || clients[slot] || !admission_enter(MAX_CLIENTS)) continue;
+        if (!c.is_logged_in && strcmp(c.name, "-") == 0) c.name[0] = '\0';
+
+        Client *cli = (Client *)malloc(sizeof(Client));
+        *cli = c;
+        cli->ping_sent = 0;
+        timer_init(&cli->timer, on_client_timer);
+        timer_schedule(&timers, &cli->timer, cli->is_logged_in ? IDLE_TIMEOUT : AUTH_TIMEOUT);
+        bucket_init(&cli->msg_bucket, CLIENT_MSG_BURST);
+        cli->throttled = 0;
+        cli->in_flight = 0;
+        clients[slot] = cli;
+
+        pthread_t tid;
+        pthread_create(&tid, NULL, handle_client, (void *)cli);
+        pthread_detach(tid);
+        resumed++;
+    }
+    fclose(f);
+
+    printf("=== HOT UPGRADE: resumed %d sessions ===\n", resumed);
+    return listen_fd;
+}
+
+// Admission gate, then a client slot and a handler thread
+void admit_connection(int new_socket) {
+    // Turn the connection away without touching clients_mutex
+    if (!admission_enter(MAX_CLIENTS)) {
+        char full_msg[64];
+        sprintf(full_msg, "SERVER:Server full, retry after %d seconds.", RETRY_AFTER_SECONDS);
+        send(new_socket, full_msg, strlen(full_msg), MSG_DONTWAIT);
+        close(new_socket);
+        return;
+    }
+
+    pthread_mutex_lock(&clients_mutex);
+    int added = 0;
+    for (int i = 0; i < MAX_CLIENTS; i++) {
+        if (!clients[i]) {
+            Client *cli = (Client *)malloc(sizeof(Client));
+            cli->socket = new_socket;
+            cli->id = uid_counter++;
+            cli->is_admin = (i == 0); 
+            cli->room_id = 0; 
+            cli->is_logged_in = 0; // NEW: Not logged in by default
+            memset(cli->name, 0, sizeof(cli->name));
+            cli->ping_sent = 0;
+            timer_init(&cli->timer, on_client_timer);
+            timer_schedule(&timers, &cli->timer, AUTH_TIMEOUT);
+            bucket_init(&cli->msg_bucket, CLIENT_MSG_BURST);
+            cli->throttled = 0;
+            cli->in_flight = 0;
+            clients[i] = cli;
+            
+            pthread_t tid;
+            pthread_create(&tid, NULL, handle_client, (void *)cli);
+            pthread_detach(tid);
+            added = 1;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&clients_mutex);
+
+    if (!added) {
+        admission_leave();
+        close(new_socket);
+    }
+}
+
+// Multishot accept: one SQE keeps producing a CQE per connection, so a burst
+// of connects is picked up in one io_uring_enter. Returns if the ring can't
+// be used; the caller then falls back to accept().
+void accept_loop_uring() {
+    Uring ring;
+    if (uring_init(&ring, 64) < 0) return;
+    int armed = 0;
+    while (1) {
+        if (!armed) {
+            struct io_uring_sqe *sqe = uring_get_sqe(&ring);
+            sqe->opcode = IORING_OP_ACCEPT;
+            sqe->fd = server_fd;
+            sqe->ioprio = IORING_ACCEPT_MULTISHOT; // accept_flags stay 0: fds must survive exec
+            armed = 1;
+        }
+        if (uring_submit(&ring, 1) < 0) break;
+
+        struct io_uring_cqe *cqe;
+        while ((cqe = uring_peek_cqe(&ring))) {
+            int res = cqe->res;
+            if (!(cqe->flags & IORING_CQE_F_MORE)) armed = 0; // Kernel stopped it; re-arm
+            uring_cqe_seen(&ring);
+            if (res >= 0) admit_connection(res);
+            else if (res == -EINVAL) { // Kernel without multishot accept
+                uring_exit(&ring);
+                return;
+            }
+        }
+    }
+    uring_exit(&ring);
+}
+
+int main(int argc, char *argv[]) {
+    int new_socket;
+    struct sockaddr_in address;
+    socklen_t addrlen = sizeof(address);
+
+    // SIGUSR2 is only ever handled by the upgrade thread
+    sigset_t set;
+    sigemptyset(&set);
+    sigaddset(&set, SIGUSR2);
+    pthread_sigmask(SIG_BLOCK, &set, NULL);
+    signal(SIGPIPE, SIG_IGN); // Peers vanishing mid-send must not kill the server
+
+    load_groups(); // NEW: Load groups from snapshot (or file) on start
+    timer_wheel_init(&timers);
+    io_backend_init(); // CHAT_IO=uring selects io_uring for accept, fan-out and log appends
+
+    // Before any handler thread exists: fanout_send sizes each broadcast by
+    // worker_count, so the pool must be complete before the first one
+    long cores = sysconf(_SC_NPROCESSORS_ONLN);
+    fanout_init(cores > 1 ? (int)cores - 1 : 0); // Broadcasting thread is the last core
+
+    if (argc == 3 && strcmp(argv[1], "--resume") == 0) {
+        server_fd = resume_sessions(atoi(argv[2]));
+        if (server_fd < 0) {
+            fprintf(stderr, "Invalid upgrade state.\n");
+            return 1;
+        }
+    } else {
+        server_fd = socket(AF_INET, SOCK_STREAM, 0);
+        address.sin_family = AF_INET;
+        address.sin_addr.s_addr = INADDR_ANY; 
+        address.sin_port = htons(PORT);
+
+        int opt = 1;
+        setsockopt(server_fd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
+
+        bind(server_fd, (struct sockaddr *)&address, sizeof(address));
+        listen(server_fd, 10);
+    }
 
-        if (!added) close(new_socket);
+    printf("=== SERVER STARTED: AUTH & GROUPS ENABLED ===\n");
+
+    pthread_t upgrade_tid;
+    pthread_create(&upgrade_tid, NULL, upgrade_handler, (void *)argv);
+    pthread_detach(upgrade_tid);
+
+    pthread_t ticker_tid;
+    pthread_create(&ticker_tid, NULL, timer_ticker, NULL);
+    pthread_detach(ticker_tid);
+
+    set_room_policy(1, 5000, 1024 * 1024); // General is the busiest channel
+
+    pthread_t compactor_tid;
+    pthread_create(&compactor_tid, NULL, log_compactor, NULL);
+    pthread_detach(compactor_tid);
+
+    pthread_t snapshot_tid;
+    pthread_create(&snapshot_tid, NULL, snapshot_refresher, NULL);
+    pthread_detach(snapshot_tid);
+
+    if (io_backend_uring()) accept_loop_uring();
+    while (1) {
+        new_socket = accept(server_fd, (struct sockaddr *)&address, &addrlen);
+        if (new_socket < 0) continue;
+        admit_connection(new_socket);
     }
     return 0;
 }
\ No newline at end of file
@@ -0,0 +1,115 @@
+#include <pthread.h>
+#include <stdatomic.h>
+#include "rate_limit.h"
+
+typedef struct { int room_id; TokenBucket bucket; } RoomBucket;
+static RoomBucket room_buckets[MAX_ROOM_BUCKETS];
+static int room_bucket_count = 0;
+static pthread_mutex_t room_buckets_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static atomic_int active_connections = 0;
+static atomic_int active_transfers = 0;
+static atomic_long throttled_client = 0;
+static atomic_long throttled_room = 0;
+static atomic_long rejected_connections = 0;
+
+void bucket_init(TokenBucket *b, double burst) {
+    b->tokens = burst;
+    clock_gettime(CLOCK_MONOTONIC, &b->last);
+}
+
+int bucket_take(TokenBucket *b, double rate, double burst) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    double elapsed = (now.tv_sec - b->last.tv_sec) + (now.tv_nsec - b->last.tv_nsec) / 1e9;
+    b->last = now;
+
+    b->tokens += elapsed * rate;
+    if (b->tokens > burst) b->tokens = burst;
+    if (b->tokens < 1.0) return 0;
+    b->tokens -= 1.0;
+    return 1;
+}
+
+// A bucket that has refilled to its burst is idle and can be handed to another room
+static int bucket_is_idle(const TokenBucket *b, const struct timespec *now) {
+    double elapsed = (now->tv_sec - b->last.tv_sec) + (now->tv_nsec - b->last.tv_nsec) / 1e9;
+    return b->tokens + elapsed * ROOM_MSG_RATE >= ROOM_MSG_BURST;
+}
+
+int room_bucket_take(int room_id) {
+    pthread_mutex_lock(&room_buckets_mutex);
+    RoomBucket *rb = NULL;
+    for (int i = 0; i < room_bucket_count; i++) {
+        if (room_buckets[i].room_id == room_id) { rb = &room_buckets[i]; break; }
+    }
+    if (!rb && room_bucket_count < MAX_ROOM_BUCKETS) {
+        rb = &room_buckets[room_bucket_count++];
+    } else if (!rb) {
+        struct timespec now;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        for (int i = 0; i < room_bucket_count && !rb; i++) {
+            if (bucket_is_idle(&room_buckets[i].bucket, &now)) rb = &room_buckets[i];
+        }
+    }
+    if (rb && rb->room_id != room_id) {
+        rb->room_id = room_id;
+        bucket_init(&rb->bucket, ROOM_MSG_BURST);
+    }
+    // Every bucket busy: let the message through rather than mute a room
+    int ok = rb ? bucket_take(&rb->bucket, ROOM_MSG_RATE, ROOM_MSG_BURST) : 1;
+    pthread_mutex_unlock(&room_buckets_mutex);
+
+    if (!ok) atomic_fetch_add(&throttled_room, 1);
+    return ok;
+}
+
+void room_bucket_remove(int room_id) {
+    pthread_mutex_lock(&room_buckets_mutex);
+    for (int i = 0; i < room_bucket_count; i++) {
+        if (room_buckets[i].room_id == room_id) {
+            room_buckets[i] = room_buckets[--room_bucket_count];
+            break;
+        }
+    }
+    pthread_mutex_unlock(&room_buckets_mutex);
+}
+
+int admission_enter(int limit) {
+    int cur = atomic_load(&active_connections);
+    do {
+        if (cur >= limit) {
+            atomic_fetch_add(&rejected_connections, 1);
+            return 0;
+        }
+    } while (!atomic_compare_exchange_weak(&active_connections, &cur, cur + 1));
+    return 1;
+}
+
+void admission_leave() {
+    atomic_fetch_sub(&active_connections, 1);
+}
+
+int transfer_enter(int limit) {
+    int cur = atomic_load(&active_transfers);
+    do {
+        if (cur >= limit) return 0;
+    } while (!atomic_compare_exchange_weak(&active_transfers, &cur, cur + 1));
+    return 1;
+}
+
+void transfer_leave() {
+    atomic_fetch_sub(&active_transfers, 1);
+}
+
+void count_throttled_client() {
+    atomic_fetch_add(&throttled_client, 1);
+}
+
+void get_rate_stats(RateStats *out) {
+    out->throttled_client = atomic_load(&throttled_client);
+    out->throttled_room = atomic_load(&throttled_room);
+    out->rejected_connections = atomic_load(&rejected_connections);
+    out->active_connections = atomic_load(&active_connections);
+    out->active_transfers = atomic_load(&active_transfers);
+}
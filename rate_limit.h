@@ -0,0 +1,46 @@
+#ifndef RATE_LIMIT_H
+#define RATE_LIMIT_H
+
+#include <time.h>
+
+// Per-connection limit on every message after login
+#define CLIENT_MSG_RATE 5.0   // Tokens refilled per second
+#define CLIENT_MSG_BURST 10.0
+// Per-room limit on public messages (each one is a log append + fan-out)
+#define ROOM_MSG_RATE 50.0
+#define ROOM_MSG_BURST 100.0
+#define MAX_ROOM_BUCKETS 128
+
+#define RETRY_AFTER_SECONDS 30 // Advertised to connections turned away when full
+
+typedef struct {
+    double tokens;
+    struct timespec last;
+} TokenBucket;
+
+typedef struct {
+    long throttled_client;
+    long throttled_room;
+    long rejected_connections;
+    int active_connections;
+    int active_transfers;
+} RateStats;
+
+void bucket_init(TokenBucket *b, double burst);
+int bucket_take(TokenBucket *b, double rate, double burst); // 1 = allowed
+
+int room_bucket_take(int room_id); // Shared room buckets, 1 = allowed; real rooms only
+void room_bucket_remove(int room_id);
+
+// Lock-free admission gate; enter returns 0 when 'limit' is reached
+int admission_enter(int limit);
+void admission_leave();
+
+// Same gate for file transfer side connections, counted apart from chat
+int transfer_enter(int limit);
+void transfer_leave();
+
+void count_throttled_client();
+void get_rate_stats(RateStats *out);
+
+#endif
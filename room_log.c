@@ -0,0 +1,361 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <zlib.h>
+#include "room_log.h"
+#include "uring.h"
+
+pthread_mutex_t file_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+// Append handles are kept open instead of fopen/fprintf/fclose per message.
+// Protected by file_mutex.
+typedef struct { int room_id; int fd; } RoomLog;
+static RoomLog room_logs[MAX_ROOM_LOGS];
+static int room_log_count = 0;
+
+// file_mutex is taken by every chat message, so compaction and search do
+// their file I/O under these instead and hold file_mutex only to swap the
+// live log. Order: compact_mutex, then archive_lock, then file_mutex.
+static pthread_mutex_t compact_mutex = PTHREAD_MUTEX_INITIALIZER; // One compaction/removal at a time
+static pthread_rwlock_t archive_lock = PTHREAD_RWLOCK_INITIALIZER; // Archive appends vs. searches
+
+// Rooms without an entry use the LOG_MAX_* defaults
+static RoomPolicy room_policies[MAX_ROOM_LOGS];
+static int room_policy_count = 0;
+
+void get_filename(int room_id, char *filename) {
+    if (room_id == 1) strcpy(filename, "chat_general.txt");
+    else if (room_id == 2) strcpy(filename, "chat_study.txt");
+    else if (room_id == 3) strcpy(filename, "chat_gaming.txt");
+    else {
+        // For custom groups, we use a generic file or specific ID file
+        sprintf(filename, "chat_group_%d.txt", room_id);
+    }
+}
+
+static int get_log_fd(int room_id) {
+    for (int i = 0; i < room_log_count; i++) {
+        if (room_logs[i].room_id == room_id) return room_logs[i].fd;
+    }
+
+    char filename[50];
+    get_filename(room_id, filename);
+    int fd = open(filename, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+    if (fd < 0) return -1;
+
+    // Table full: evict the oldest handle
+    if (room_log_count == MAX_ROOM_LOGS) {
+        close(room_logs[0].fd);
+        memmove(&room_logs[0], &room_logs[1], sizeof(RoomLog) * (MAX_ROOM_LOGS - 1));
+        room_log_count--;
+    }
+    room_logs[room_log_count].room_id = room_id;
+    room_logs[room_log_count].fd = fd;
+    room_log_count++;
+    return fd;
+}
+
+// Caller holds file_mutex
+static void drop_log_fd(int room_id) {
+    for (int i = 0; i < room_log_count; i++) {
+        if (room_logs[i].room_id == room_id) {
+            close(room_logs[i].fd);
+            room_logs[i] = room_logs[--room_log_count];
+            return;
+        }
+    }
+}
+
+// Returns a NUL-terminated copy of the first 'limit' bytes of the file
+// (the whole file if limit < 0), or NULL. Callers reading the whole file hold
+// file_mutex; a bounded read only sees bytes already appended under it.
+static char *read_log(const char *filename, long limit, size_t *len) {
+    char *data = NULL;
+    *len = 0;
+    FILE *f = fopen(filename, "r");
+    if (f) {
+        fseek(f, 0, SEEK_END);
+        long size = ftell(f);
+        rewind(f);
+        if (limit >= 0 && limit < size) size = limit;
+        if (size > 0 && (data = malloc(size + 1))) {
+            *len = fread(data, 1, size, f);
+            data[*len] = '\0';
+        }
+        fclose(f);
+    }
+    return data;
+}
+
+// io_uring backend for appends; protected by file_mutex like the fds
+static Uring log_ring;
+static int log_ring_state = 0; // 0 untried, 1 ready, -1 unavailable
+
+// Caller holds file_mutex. Message and newline go out as two linked writes
+// in one io_uring_enter; the link keeps them in order. Returns 0 if the
+// caller should fall back to writev.
+static int append_uring(int fd, const char *message, size_t len) {
+    if (log_ring_state == 0) log_ring_state = uring_init(&log_ring, 8) == 0 ? 1 : -1;
+    if (log_ring_state < 0) return 0;
+
+    // The ring is drained after every append, so both SQEs always fit
+    struct io_uring_sqe *w = uring_get_sqe(&log_ring);
+    w->opcode = IORING_OP_WRITE;
+    w->fd = fd;
+    w->addr = (unsigned long)message;
+    w->len = len;
+    w->off = (__u64)-1; // Current position; O_APPEND puts it at the end
+    w->flags = IOSQE_IO_LINK;
+    struct io_uring_sqe *nl = uring_get_sqe(&log_ring);
+    nl->opcode = IORING_OP_WRITE;
+    nl->fd = fd;
+    nl->addr = (unsigned long)"\n";
+    nl->len = 1;
+    nl->off = (__u64)-1;
+
+    if (uring_submit(&log_ring, 2) < 0) {
+        // Nothing went in; drop the ring (and its queued SQEs) for good
+        uring_exit(&log_ring);
+        log_ring_state = -1;
+        return 0;
+    }
+    struct io_uring_cqe *cqe;
+    while ((cqe = uring_peek_cqe(&log_ring))) {
+        if (cqe->res < 0) fprintf(stderr, "io_uring write: %s\n", strerror(-cqe->res));
+        uring_cqe_seen(&log_ring);
+    }
+    return 1;
+}
+
+void save_message_to_file(int room_id, const char *message) {
+    pthread_mutex_lock(&file_mutex);
+    int fd = get_log_fd(room_id);
+    size_t len = strlen(message);
+    if (fd >= 0 && !(io_backend_uring() && append_uring(fd, message, len))) {
+        // Message and newline go out in a single append
+        struct iovec iov[2] = {
+            { (void *)message, len },
+            { "\n", 1 }
+        };
+        if (writev(fd, iov, 2) < 0) perror("writev");
+    }
+    pthread_mutex_unlock(&file_mutex);
+}
+
+void send_history_to_client(int socket, int room_id) {
+    char filename[50];
+    get_filename(room_id, filename);
+
+    // Slurp the log under the lock, then pace the replay without holding it,
+    // so a long replay doesn't stall every other room's appends.
+    pthread_mutex_lock(&file_mutex);
+    size_t len;
+    char *data = read_log(filename, -1, &len);
+    pthread_mutex_unlock(&file_mutex);
+    if (!data) return;
+
+    char *saveptr;
+    char *line = strtok_r(data, "\n", &saveptr);
+    while (line) {
+        send(socket, line, strlen(line), 0);
+        usleep(1000); // Client treats each recv as one message
+        line = strtok_r(NULL, "\n", &saveptr);
+    }
+    free(data);
+}
+
+void close_room_logs() {
+    pthread_mutex_lock(&file_mutex);
+    for (int i = 0; i < room_log_count; i++) close(room_logs[i].fd);
+    room_log_count = 0;
+    pthread_mutex_unlock(&file_mutex);
+}
+
+// --- RETENTION ---
+
+void set_room_policy(int room_id, int max_messages, long max_bytes) {
+    pthread_mutex_lock(&file_mutex);
+    int i = 0;
+    while (i < room_policy_count && room_policies[i].room_id != room_id) i++;
+    if (i < MAX_ROOM_LOGS) {
+        room_policies[i].room_id = room_id;
+        room_policies[i].max_messages = max_messages;
+        room_policies[i].max_bytes = max_bytes;
+        if (i == room_policy_count) room_policy_count++;
+    }
+    pthread_mutex_unlock(&file_mutex);
+}
+
+static RoomPolicy get_room_policy(int room_id) {
+    for (int i = 0; i < room_policy_count; i++) {
+        if (room_policies[i].room_id == room_id) return room_policies[i];
+    }
+    RoomPolicy def = { room_id, LOG_MAX_MESSAGES, LOG_MAX_BYTES };
+    return def;
+}
+
+// Caller holds file_mutex. Appends whatever reached the live log past its
+// first 'from' bytes onto the rewritten copy in 'tmp'; usually nothing.
+static int copy_log_tail(const char *filename, long from, const char *tmp) {
+    FILE *in = fopen(filename, "r");
+    if (!in) return 0; // Log removed under us
+    FILE *out = fopen(tmp, "a");
+    int ok = out && fseek(in, from, SEEK_SET) == 0;
+    char buf[4096];
+    size_t n;
+    while (ok && (n = fread(buf, 1, sizeof(buf), in)) > 0) ok = fwrite(buf, 1, n, out) == n;
+    if (out && fclose(out) != 0) ok = 0;
+    fclose(in);
+    return ok;
+}
+
+int compact_room_log(int room_id) {
+    char filename[50], archive[64], old_archive[72], tmp[64];
+    get_filename(room_id, filename);
+    sprintf(archive, "%s.gz", filename);
+    sprintf(old_archive, "%s.old", archive);
+    sprintf(tmp, "%s.tmp", filename);
+
+    pthread_mutex_lock(&compact_mutex);
+
+    // Appends happen whole under file_mutex, so the size seen here ends on a
+    // line boundary and the bytes before it are stable to read unlocked
+    pthread_mutex_lock(&file_mutex);
+    RoomPolicy policy = get_room_policy(room_id);
+    struct stat st;
+    long snapshot = stat(filename, &st) == 0 ? (long)st.st_size : 0;
+    pthread_mutex_unlock(&file_mutex);
+
+    size_t len;
+    char *data = snapshot > 0 ? read_log(filename, snapshot, &len) : NULL;
+    if (!data) {
+        pthread_mutex_unlock(&compact_mutex);
+        return 0;
+    }
+
+    // Walk back from the end until either limit is hit; everything before
+    // 'keep' moves to the archive.
+    size_t keep = len;
+    int lines = 0;
+    while (keep > 0) {
+        size_t start = keep - 1; // keep - 1 is the newline ending this line
+        while (start > 0 && data[start - 1] != '\n') start--;
+        if (lines + 1 > policy.max_messages || (long)(len - start) > policy.max_bytes) break;
+        keep = start;
+        lines++;
+    }
+
+    int trimmed = 0;
+    if (keep > 0) {
+        // Held until the live log is swapped: if the swap fails, the member
+        // just written is cut off again so the lines aren't archived twice
+        pthread_rwlock_wrlock(&archive_lock);
+        if (stat(archive, &st) == 0 && st.st_size > LOG_ARCHIVE_MAX_BYTES) rename(archive, old_archive);
+        off_t archive_before = stat(archive, &st) == 0 ? st.st_size : 0;
+        gzFile gz = gzopen(archive, "ab"); // Each compaction appends one gzip member
+        int ok = gz && gzwrite(gz, data, keep) == (int)keep;
+        if (gz && gzclose(gz) != Z_OK) ok = 0;
+
+        FILE *f = ok ? fopen(tmp, "w") : NULL;
+        if (f) {
+            ok = fwrite(data + keep, 1, len - keep, f) == len - keep;
+            if (fclose(f) != 0) ok = 0;
+        }
+
+        // Only the swap is done under file_mutex: pick up lines appended
+        // since the snapshot, then replace the live log
+        if (f && ok) {
+            pthread_mutex_lock(&file_mutex);
+            if (copy_log_tail(filename, (long)len, tmp) && rename(tmp, filename) == 0) {
+                drop_log_fd(room_id); // Next append reopens the new file
+                trimmed = 1;
+            }
+            pthread_mutex_unlock(&file_mutex);
+        }
+        if (!trimmed) {
+            remove(tmp);
+            if (truncate(archive, archive_before) != 0) perror("truncate archive");
+        }
+        pthread_rwlock_unlock(&archive_lock);
+    }
+    pthread_mutex_unlock(&compact_mutex);
+    free(data);
+    return trimmed;
+}
+
+// Collects matching lines of one archive into the ring of newest matches
+static void scan_archive(const char *path, const char *needle, char **matches, int *count) {
+    gzFile gz = gzopen(path, "rb");
+    if (!gz) return;
+    char line[2048];
+    while (gzgets(gz, line, sizeof(line))) {
+        if (!strstr(line, needle)) continue;
+        line[strcspn(line, "\n")] = 0;
+        free(matches[*count % SEARCH_MAX_RESULTS]);
+        matches[*count % SEARCH_MAX_RESULTS] = strdup(line);
+        (*count)++;
+    }
+    gzclose(gz);
+}
+
+void send_archive_matches(int socket, int room_id, const char *needle) {
+    char filename[50], archive[64], old_archive[72];
+    get_filename(room_id, filename);
+    sprintf(archive, "%s.gz", filename);
+    sprintf(old_archive, "%s.old", archive);
+
+    // Keep only the newest SEARCH_MAX_RESULTS matches. The read lock only
+    // excludes archive appends; chat never waits on it.
+    char *matches[SEARCH_MAX_RESULTS] = { 0 };
+    int count = 0;
+    pthread_rwlock_rdlock(&archive_lock);
+    scan_archive(old_archive, needle, matches, &count);
+    scan_archive(archive, needle, matches, &count);
+    pthread_rwlock_unlock(&archive_lock);
+
+    int first = count > SEARCH_MAX_RESULTS ? count - SEARCH_MAX_RESULTS : 0;
+    for (int i = first; i < count; i++) {
+        char *m = matches[i % SEARCH_MAX_RESULTS];
+        if (m) send(socket, m, strlen(m), 0);
+        usleep(1000);
+    }
+    for (int i = 0; i < SEARCH_MAX_RESULTS; i++) free(matches[i]);
+}
+
+void remove_room_log(int room_id) {
+    char filename[50], archive[64], old_archive[72];
+    get_filename(room_id, filename);
+    sprintf(archive, "%s.gz", filename);
+    sprintf(old_archive, "%s.old", archive);
+
+    pthread_mutex_lock(&compact_mutex);
+    pthread_rwlock_wrlock(&archive_lock);
+    remove(archive);
+    remove(old_archive);
+    pthread_rwlock_unlock(&archive_lock);
+
+    pthread_mutex_lock(&file_mutex);
+    drop_log_fd(room_id);
+    remove(filename);
+    for (int i = 0; i < room_policy_count; i++) {
+        if (room_policies[i].room_id == room_id) {
+            room_policies[i] = room_policies[--room_policy_count];
+            break;
+        }
+    }
+    pthread_mutex_unlock(&file_mutex);
+    pthread_mutex_unlock(&compact_mutex);
+}
+
+void room_log_freeze() {
+    pthread_mutex_lock(&compact_mutex);
+}
+
+void room_log_thaw() {
+    pthread_mutex_unlock(&compact_mutex);
+}
@@ -0,0 +1,41 @@
+#ifndef ROOM_LOG_H
+#define ROOM_LOG_H
+
+#include <pthread.h>
+
+#define MAX_ROOM_LOGS 128 // Cached append handles (3 public rooms + custom groups)
+
+// Default retention; live logs beyond either limit are trimmed into <log>.gz
+#define LOG_MAX_MESSAGES 1000
+#define LOG_MAX_BYTES (256 * 1024)
+#define SEARCH_MAX_RESULTS 50
+// Past this the archive rotates to <log>.gz.old, replacing the previous one,
+// so at most twice this much compressed history is kept per room
+#define LOG_ARCHIVE_MAX_BYTES (4L * 1024 * 1024)
+
+typedef struct {
+    int room_id;
+    int max_messages;
+    long max_bytes;
+} RoomPolicy;
+
+extern pthread_mutex_t file_mutex;
+
+// Room history files
+void get_filename(int room_id, char *filename);
+void save_message_to_file(int room_id, const char *message);
+void send_history_to_client(int socket, int room_id);
+void close_room_logs();
+
+// Retention & archive
+void set_room_policy(int room_id, int max_messages, long max_bytes);
+int compact_room_log(int room_id); // Returns 1 if the live log was trimmed
+void send_archive_matches(int socket, int room_id, const char *needle);
+void remove_room_log(int room_id); // Deletes live log and archive
+
+// Waits out any compaction or removal and blocks new ones until thawed, so
+// an exec never lands mid-archive-write (hot upgrade)
+void room_log_freeze();
+void room_log_thaw();
+
+#endif
@@ -0,0 +1,66 @@
+#include "timer_wheel.h"
+
+static void unlink_node(TimerNode *node) {
+    node->prev->next = node->next;
+    node->next->prev = node->prev;
+    node->next = node->prev = node;
+    node->active = 0;
+}
+
+// Caller holds w->lock
+static void insert_node(TimerWheel *w, TimerNode *node, unsigned int ticks) {
+    if (ticks == 0) ticks = 1; // Never land in the slot being processed
+    node->expires = w->now + ticks;
+    TimerNode *head = &w->slots[node->expires & (WHEEL_SLOTS - 1)];
+    node->prev = head->prev;
+    node->next = head;
+    head->prev->next = node;
+    head->prev = node;
+    node->active = 1;
+}
+
+void timer_wheel_init(TimerWheel *w) {
+    for (int i = 0; i < WHEEL_SLOTS; i++) {
+        w->slots[i].next = w->slots[i].prev = &w->slots[i];
+    }
+    w->now = 0;
+    pthread_mutex_init(&w->lock, NULL);
+}
+
+void timer_init(TimerNode *node, TimerCallback callback) {
+    node->next = node->prev = node;
+    node->expires = 0;
+    node->callback = callback;
+    node->active = 0;
+}
+
+void timer_schedule(TimerWheel *w, TimerNode *node, unsigned int ticks) {
+    pthread_mutex_lock(&w->lock);
+    if (node->active) unlink_node(node);
+    insert_node(w, node, ticks);
+    pthread_mutex_unlock(&w->lock);
+}
+
+void timer_cancel(TimerWheel *w, TimerNode *node) {
+    pthread_mutex_lock(&w->lock);
+    if (node->active) unlink_node(node);
+    pthread_mutex_unlock(&w->lock);
+}
+
+void timer_tick(TimerWheel *w) {
+    pthread_mutex_lock(&w->lock);
+    w->now++;
+    TimerNode *head = &w->slots[w->now & (WHEEL_SLOTS - 1)];
+    TimerNode *node = head->next;
+    while (node != head) {
+        TimerNode *next = node->next;
+        // Nodes for a later round share the slot; leave them in place
+        if (node->expires <= w->now) {
+            unlink_node(node);
+            unsigned int again = node->callback(node);
+            if (again) insert_node(w, node, again);
+        }
+        node = next;
+    }
+    pthread_mutex_unlock(&w->lock);
+}
@@ -0,0 +1,34 @@
+#ifndef TIMER_WHEEL_H
+#define TIMER_WHEEL_H
+
+#include <pthread.h>
+
+#define WHEEL_SLOTS 512 // Power of two; longer delays just take extra rounds
+
+typedef struct TimerNode TimerNode;
+
+// Runs with the wheel locked, so it must not call back into the wheel.
+// Returns 0 when done, or a number of ticks after which to fire again.
+typedef unsigned int (*TimerCallback)(TimerNode *node);
+
+// Embedded in the owning struct; no allocation per timer
+struct TimerNode {
+    TimerNode *next, *prev;
+    unsigned long expires; // Absolute tick
+    TimerCallback callback;
+    int active;
+};
+
+typedef struct {
+    TimerNode slots[WHEEL_SLOTS]; // Sentinel heads of circular lists
+    unsigned long now;
+    pthread_mutex_t lock;
+} TimerWheel;
+
+void timer_wheel_init(TimerWheel *w);
+void timer_init(TimerNode *node, TimerCallback callback);
+void timer_schedule(TimerWheel *w, TimerNode *node, unsigned int ticks); // (Re)arm, O(1)
+void timer_cancel(TimerWheel *w, TimerNode *node);                       // O(1)
+void timer_tick(TimerWheel *w); // Advance one tick and fire due timers
+
+#endif
@@ -0,0 +1,178 @@
+// upgrade_load.c - Chat load driver that hot-upgrades the server mid-run
+// Compile: gcc -O2 upgrade_load.c -o upgrade_load -pthread
+// Run:     ./upgrade_load $(pidof server) [senders] [seconds]
+//
+// Senders post numbered lines to General while one listener checks that every
+// line arrives exactly once and in order. Halfway through, the server gets
+// SIGUSR2. Exits non-zero on any disconnect or lost, duplicated or reordered line.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <signal.h>
+#include <errno.h>
+#include <pthread.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+
+#define PORT 8080
+#define MAX_SENDERS 32
+#define SEND_INTERVAL_US 250000 // 4 lines/sec each, under the per-connection budget
+
+static int senders = 8, seconds = 10;
+static int sender_socks[MAX_SENDERS];
+static int sent[MAX_SENDERS];
+static volatile int sending = 1;
+
+// Listener's view of each sender's sequence
+static int next_seq[MAX_SENDERS];
+static int out_of_order = 0;
+static int listener_dropped = 0;
+
+static int connect_as(const char *name) {
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    struct sockaddr_in sa = { .sin_family = AF_INET, .sin_port = htons(PORT) };
+    inet_pton(AF_INET, "127.0.0.1", &sa.sin_addr);
+    if (fd < 0 || connect(fd, (struct sockaddr *)&sa, sizeof(sa)) < 0) {
+        perror("connect");
+        exit(1);
+    }
+    send(fd, name, strlen(name), 0);
+    usleep(100000); // Name and command must arrive as separate messages
+
+    char cmd[128], reply[4096];
+    sprintf(cmd, "/register %s pw", name);
+    send(fd, cmd, strlen(cmd), 0);
+    int n = recv(fd, reply, sizeof(reply) - 1, 0);
+    reply[n > 0 ? n : 0] = '\0';
+    if (strstr(reply, "taken")) {
+        usleep(100000);
+        sprintf(cmd, "/login %s pw", name);
+        send(fd, cmd, strlen(cmd), 0);
+        n = recv(fd, reply, sizeof(reply) - 1, 0);
+        reply[n > 0 ? n : 0] = '\0';
+    }
+    if (!strstr(reply, "Login successful") && !strstr(reply, "Registered")) {
+        fprintf(stderr, "%s: could not log in\n", name);
+        exit(1);
+    }
+    return fd;
+}
+
+// Lines are "L<sender>-<seq>;" so they can be picked out of any framing,
+// including several coalesced into one recv after the upgrade
+static void scan_tokens(const char *text) {
+    const char *p = text;
+    while ((p = strchr(p, 'L'))) {
+        int who, seq, used;
+        if (sscanf(p, "L%d-%d;%n", &who, &seq, &used) == 2 && who >= 0 && who < senders) {
+            if (seq != next_seq[who]) out_of_order++;
+            next_seq[who] = seq + 1;
+            p += used;
+        } else {
+            p++;
+        }
+    }
+}
+
+static void *listener(void *arg) {
+    int fd = *(int *)arg;
+    char buf[8192];
+    size_t carry = 0;
+    while (1) {
+        ssize_t n = recv(fd, buf + carry, sizeof(buf) - carry - 1, 0);
+        if (n == 0 || (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK)) {
+            listener_dropped = 1;
+            return NULL;
+        }
+        if (n < 0) { // Receive timeout: the run is over
+            if (!sending) return NULL;
+            continue;
+        }
+        carry += n;
+        buf[carry] = '\0';
+
+        // Parse up to the last complete token; keep the tail for the next recv
+        char *end = strrchr(buf, ';');
+        size_t done = end ? (size_t)(end - buf + 1) : 0;
+        char saved = buf[done];
+        buf[done] = '\0';
+        scan_tokens(buf);
+        buf[done] = saved;
+        carry -= done;
+        memmove(buf, buf + done, carry);
+        if (carry > 64) { // Not part of a token
+            memmove(buf, buf + carry - 64, 64);
+            carry = 64;
+        }
+    }
+}
+
+static void *sender(void *arg) {
+    int id = (int)(long)arg;
+    char line[64], sink[4096];
+    while (sending) {
+        sprintf(line, "L%d-%d;", id, sent[id]);
+        if (send(sender_socks[id], line, strlen(line), MSG_NOSIGNAL) < 0) return NULL;
+        sent[id]++;
+        while (recv(sender_socks[id], sink, sizeof(sink), MSG_DONTWAIT) > 0); // Others' lines
+        usleep(SEND_INTERVAL_US);
+    }
+    return NULL;
+}
+
+// Still connected if the socket has nothing but (possibly) pending data
+static int still_connected(int fd) {
+    char sink[4096];
+    ssize_t n;
+    while ((n = recv(fd, sink, sizeof(sink), MSG_DONTWAIT)) > 0);
+    return n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK);
+}
+
+int main(int argc, char *argv[]) {
+    if (argc < 2) {
+        fprintf(stderr, "Usage: %s <server_pid> [senders] [seconds]\n", argv[0]);
+        return 1;
+    }
+    pid_t server = atoi(argv[1]);
+    if (argc > 2) senders = atoi(argv[2]);
+    if (argc > 3) seconds = atoi(argv[3]);
+    if (senders < 1 || senders > MAX_SENDERS) senders = 8;
+
+    int rx = connect_as("loadrx");
+    struct timeval tv = { 1, 0 };
+    setsockopt(rx, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    char sink[4096];
+    while (recv(rx, sink, sizeof(sink), 0) > 0); // History replay, including earlier runs' lines
+    char name[32];
+    for (int i = 0; i < senders; i++) {
+        sprintf(name, "load%d", i);
+        sender_socks[i] = connect_as(name);
+    }
+    usleep(500000); // Let join announcements and history settle
+
+    pthread_t rx_tid, tx_tid[MAX_SENDERS];
+    pthread_create(&rx_tid, NULL, listener, &rx);
+    for (long i = 0; i < senders; i++) pthread_create(&tx_tid[i], NULL, sender, (void *)i);
+
+    sleep(seconds / 2);
+    printf("Sending SIGUSR2 to %d\n", server);
+    if (kill(server, SIGUSR2) < 0) perror("kill");
+    sleep(seconds - seconds / 2);
+
+    sending = 0;
+    for (int i = 0; i < senders; i++) pthread_join(tx_tid[i], NULL);
+    sleep(2); // Last lines in transit
+    pthread_join(rx_tid, NULL);
+
+    int disconnects = listener_dropped, lost = 0, total = 0;
+    for (int i = 0; i < senders; i++) {
+        if (!still_connected(sender_socks[i])) disconnects++;
+        lost += sent[i] - next_seq[i];
+        total += sent[i];
+    }
+    printf("{\"senders\": %d, \"sent\": %d, \"lost\": %d, \"out_of_order\": %d, \"disconnects\": %d}\n",
+           senders, total, lost, out_of_order, disconnects);
+    return (lost || out_of_order || disconnects) ? 1 : 0;
+}
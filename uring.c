@@ -0,0 +1,118 @@
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <stdatomic.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include "uring.h"
+
+static int use_uring = 0;
+static int probed = 0, supported = 0;
+
+int uring_init(Uring *r, unsigned entries) {
+    struct io_uring_params p;
+    memset(&p, 0, sizeof(p));
+    memset(r, 0, sizeof(*r));
+    int fd = syscall(__NR_io_uring_setup, entries, &p); // Always O_CLOEXEC
+    if (fd < 0) return -errno;
+
+    r->fd = fd;
+    r->sq_entries = p.sq_entries;
+    r->sq_map_len = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    r->cq_map_len = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    r->sqes_len = p.sq_entries * sizeof(struct io_uring_sqe);
+
+    // Kernels with SINGLE_MMAP share one mapping for both rings
+    int single = p.features & IORING_FEAT_SINGLE_MMAP;
+    if (single && r->cq_map_len > r->sq_map_len) r->sq_map_len = r->cq_map_len;
+    r->sq_map = mmap(NULL, r->sq_map_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+    r->cq_map = single ? r->sq_map
+                       : mmap(NULL, r->cq_map_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+    r->sqes = mmap(NULL, r->sqes_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+    if (r->sq_map == MAP_FAILED || r->cq_map == MAP_FAILED || r->sqes == MAP_FAILED) {
+        int err = errno;
+        uring_exit(r);
+        return -err;
+    }
+
+    char *sq = r->sq_map, *cq = r->cq_map;
+    r->sq_head = (unsigned *)(sq + p.sq_off.head);
+    r->sq_tail = (unsigned *)(sq + p.sq_off.tail);
+    r->sq_mask = (unsigned *)(sq + p.sq_off.ring_mask);
+    r->sq_array = (unsigned *)(sq + p.sq_off.array);
+    r->cq_head = (unsigned *)(cq + p.cq_off.head);
+    r->cq_tail = (unsigned *)(cq + p.cq_off.tail);
+    r->cq_mask = (unsigned *)(cq + p.cq_off.ring_mask);
+    r->cqes = (struct io_uring_cqe *)(cq + p.cq_off.cqes);
+    return 0;
+}
+
+void uring_exit(Uring *r) {
+    if (r->sqes && r->sqes != MAP_FAILED) munmap(r->sqes, r->sqes_len);
+    if (r->cq_map && r->cq_map != MAP_FAILED && r->cq_map != r->sq_map) munmap(r->cq_map, r->cq_map_len);
+    if (r->sq_map && r->sq_map != MAP_FAILED) munmap(r->sq_map, r->sq_map_len);
+    if (r->fd > 0) close(r->fd);
+    memset(r, 0, sizeof(*r));
+}
+
+struct io_uring_sqe *uring_get_sqe(Uring *r) {
+    unsigned tail = *r->sq_tail; // Only we write the tail
+    unsigned head = atomic_load_explicit((_Atomic unsigned *)r->sq_head, memory_order_acquire);
+    if (tail - head >= r->sq_entries) return NULL;
+
+    unsigned idx = tail & *r->sq_mask;
+    struct io_uring_sqe *sqe = &r->sqes[idx];
+    memset(sqe, 0, sizeof(*sqe));
+    r->sq_array[idx] = idx;
+    atomic_store_explicit((_Atomic unsigned *)r->sq_tail, tail + 1, memory_order_release);
+    r->to_submit++;
+    return sqe;
+}
+
+int uring_submit(Uring *r, unsigned wait_nr) {
+    while (1) {
+        int ret = syscall(__NR_io_uring_enter, r->fd, r->to_submit, wait_nr,
+                          wait_nr ? IORING_ENTER_GETEVENTS : 0, NULL, 0);
+        if (ret >= 0) {
+            r->to_submit -= ret;
+            return ret;
+        }
+        if (errno != EINTR) return -errno;
+    }
+}
+
+struct io_uring_cqe *uring_peek_cqe(Uring *r) {
+    unsigned head = *r->cq_head; // Only we write the head
+    unsigned tail = atomic_load_explicit((_Atomic unsigned *)r->cq_tail, memory_order_acquire);
+    return head == tail ? NULL : &r->cqes[head & *r->cq_mask];
+}
+
+void uring_cqe_seen(Uring *r) {
+    atomic_store_explicit((_Atomic unsigned *)r->cq_head, *r->cq_head + 1, memory_order_release);
+}
+
+// --- BACKEND SELECTION ---
+
+void io_backend_set(int uring) {
+    if (uring && !probed) {
+        Uring probe;
+        supported = uring_init(&probe, 2) == 0;
+        if (supported) uring_exit(&probe);
+        probed = 1;
+    }
+    use_uring = uring && supported;
+}
+
+int io_backend_init() {
+    const char *choice = getenv("CHAT_IO");
+    int want = choice && strcmp(choice, "uring") == 0;
+    io_backend_set(want);
+    if (want && !use_uring) printf("io_uring unavailable, using the default I/O path\n");
+    return use_uring;
+}
+
+int io_backend_uring() {
+    return use_uring;
+}
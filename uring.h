@@ -0,0 +1,36 @@
+#ifndef URING_H
+#define URING_H
+
+#include <linux/io_uring.h>
+
+#define URING_ENTRIES 256 // SQ size per ring; larger batches are split
+
+// Minimal io_uring over the raw syscalls (no liburing dependency). A ring is
+// used by one thread at a time; callers serialize with their own lock.
+typedef struct {
+    int fd;
+    unsigned *sq_head, *sq_tail, *sq_mask, *sq_array;
+    unsigned *cq_head, *cq_tail, *cq_mask;
+    struct io_uring_sqe *sqes;
+    struct io_uring_cqe *cqes;
+    unsigned sq_entries;
+    unsigned to_submit; // Queued since the last uring_submit
+    void *sq_map, *cq_map;
+    size_t sq_map_len, cq_map_len, sqes_len;
+} Uring;
+
+int uring_init(Uring *r, unsigned entries); // 0 on success, -errno otherwise
+void uring_exit(Uring *r);
+struct io_uring_sqe *uring_get_sqe(Uring *r); // Zeroed; NULL when the SQ is full
+int uring_submit(Uring *r, unsigned wait_nr); // Submits queued SQEs, waits for wait_nr CQEs
+struct io_uring_cqe *uring_peek_cqe(Uring *r); // NULL when the CQ is empty
+void uring_cqe_seen(Uring *r);
+
+// I/O backend, chosen once at startup: CHAT_IO=uring in the environment
+// (which survives a hot upgrade's exec). Falls back to plain syscalls when
+// the kernel has no io_uring or refuses it.
+int io_backend_init(); // Returns 1 if io_uring is in use
+int io_backend_uring();
+void io_backend_set(int uring); // Benchmarks switch backends directly; falls back the same way
+
+#endif